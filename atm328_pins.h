@@ -47,7 +47,14 @@
 #endif
 
 // GDO2 connection
-#if( GDO2==INT1 )
+#if defined(GDO2_ICP1)
+  // Timer1 input capture, Arduino D8
+  #define GDO2_INT_VECT   TIMER1_CAPT_vect
+  #define GDO2_DDR        DDRB
+  #define GDO2_PORT       PORTB
+  #define GDO2_PIN        PINB
+  #define GDO2_IN         ( 1 << PORTB0 )
+#elif( GDO2==INT1 )
   #define GDO2_INT_MASK   ( 1 << INT1 )
   #define GDO2_INT_VECT   INT1_vect
   #define GDO2_INT_ISCn0  ISC10
@@ -76,7 +83,11 @@
 #define SW_INT_PORT      PORTB
 #define SW_INT_PIN       PINB
 #define SW_INT_DDR       DDRB
-#define SW_INT_IN        ( 1<<PORTB0 )
+#if defined(GDO2_ICP1)
+  #define SW_INT_IN      ( 1<<PORTB1 )  // PORTB0 is ICP1
+#else
+  #define SW_INT_IN      ( 1<<PORTB0 )
+#endif
 
 // SOme debug pins
 #define DEBUG_PORT        PORTC
@@ -92,6 +103,10 @@
 #define TTY_UDRE_VECT   USART_UDRE_vect
 #define TTY_RX_VECT     USART_RX_vect
 
+// Radio UART timers
+#define RX_CLOCK_OVF_VECT TIMER1_OVF_vect
+#define TX_CLOCK_VECT     TIMER0_COMPA_vect
+
 // LED
 #define LED_DDR   DDRB
 #define LED_PORT  PORTB
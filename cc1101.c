@@ -16,7 +16,7 @@
 //#define ENABLE_TX
 
 #include "spi.h"
-#include "config.h"
+#include "hal.h"
 #include "cc1101_const.h"
 #include "cc1101.h"
 
@@ -44,7 +44,7 @@ static const uint8_t PROGMEM CC_REGISTER_VALUES[] = {
 
   CC1100_MCSM2,   0x07,  //
   CC1100_MCSM1,   0x30,  // CCA_MODE unless currently receiving a packet, RXOFF_MODE to IDLE , TX_OFF_MODE to IDLE
-  CC1100_MCSM0,   0x18,  // (0x18=11000 FS_AUTOCAL=1 When going from IDLE to RX or TX)
+  CC1100_MCSM0,   0x08,  // (0x08=01000 FS_AUTOCAL=0 Never, see cc_calibrate())
 
   CC1100_FOCCFG,  0x16,  //
 
@@ -65,8 +65,61 @@ static const uint8_t PROGMEM CC_REGISTER_VALUES[] = {
   CC1100_PATABLE, 0xC3   //
 };
 
+#if defined(UART_RX_FIFO)
+// RX through the FIFO
+// The sync word is the last 8 data bits of SYNC0 (0xFF) and the
+// first 8 bits of SYNC1 (0x00) so a long STOP bit between them
+// doesn't matter.
+static const uint8_t PROGMEM CC_RX_VALUES[] = {
+  CC1100_IOCFG2,   0x00,  // GDO2- RX FIFO at or above threshold
+  CC1100_FIFOTHR,  0x01,  // RX FIFO threshold 8 bytes
+  CC1100_SYNC1,    0xFF,  //
+  CC1100_SYNC0,    0x00,  //
+  CC1100_PKTCTRL0, 0x02,  // FIFO, infinite packet length
+  CC1100_MDMCFG2,  0x12,  // (GFSK  16/16 Sync Word)
+};
+#elif defined(UART_TX_FIFO)
+// RX asynchronous serial on GDO2
+static const uint8_t PROGMEM CC_RX_VALUES[] = {
+  CC1100_IOCFG2,   0x0D,  // GDO2- RX data
+  CC1100_PKTCTRL0, 0x32,  //
+  CC1100_MDMCFG2,  0x10,  // (GFSK  No Sync Word)
+};
+#endif
+
+#if defined(UART_TX_FIFO)
+// TX through the FIFO
+// The bitstream already holds the UART framing, preamble and sync word
+static const uint8_t PROGMEM CC_TX_VALUES[] = {
+  CC1100_IOCFG0,   0x42,  // GDO0- TX FIFO below threshold
+  CC1100_FIFOTHR,  0x07,  // TX FIFO threshold 33 bytes
+  CC1100_PKTCTRL0, 0x02,  // FIFO, infinite packet length
+  CC1100_MDMCFG2,  0x10,  // (GFSK  No preamble/Sync Word)
+};
+#elif defined(UART_RX_FIFO)
+// TX asynchronous serial on GDO0
+static const uint8_t PROGMEM CC_TX_VALUES[] = {
+  CC1100_IOCFG2,   0x0D,  // GDO2- RX data
+  CC1100_PKTCTRL0, 0x32,  //
+  CC1100_MDMCFG2,  0x10,  // (GFSK  No Sync Word)
+};
+#endif
+
+#if defined(UART_RX_FIFO) || defined(UART_TX_FIFO)
+#define CC_MODE_VALUES
+
+// The FIFOs are serviced from ISRs so they mustn't interrupt
+// an SPI transaction made from main_work()
+#define CC_SPI_LOCK()    uint8_t sreg = SREG; cli()
+#define CC_SPI_UNLOCK()  SREG = sreg
+#else
+#define CC_SPI_LOCK()    do{}while(0)
+#define CC_SPI_UNLOCK()  do{}while(0)
+#endif
+
 static uint8_t cc_read( uint8_t addr ) {
   uint8_t data ;
+  CC_SPI_LOCK();
 
   spi_assert();
 
@@ -77,11 +130,13 @@ static uint8_t cc_read( uint8_t addr ) {
 
   spi_deassert();
 
+  CC_SPI_UNLOCK();
   return data;
 }
 
 static uint8_t cc_write(uint8_t addr, uint8_t b) {
   uint8_t result;
+  CC_SPI_LOCK();
 
   spi_assert();
 
@@ -91,37 +146,210 @@ static uint8_t cc_write(uint8_t addr, uint8_t b) {
   result = spi_send(b);
 
   spi_deassert();
+
+  CC_SPI_UNLOCK();
   return result;
 }
 
-#define INT_MASK GDO2_INT_MASK
+static void cc_write_regs( const uint8_t *values, uint8_t len ) {
+  for (uint8_t i = 0; i < len; ) {
+    uint8_t reg = pgm_read_byte(&values[i++]);
+    uint8_t val = pgm_read_byte(&values[i++]);
+    cc_write(reg, val);
+  }
+}
+
+/***************************************************************
+** Frequency synthesizer calibration
+**
+** There's only one channel so the synthesizer is calibrated with
+** SCAL and not on every way out of IDLE. RX and TX are entered
+** without the deaf time of a calibration. The results in
+** FSCAL3..1 are kept until the next calibration.
+**
+** There's no temperature reading to say when that's due so the
+** caller passes the time in ms. The interval doubles from
+** CC_CAL_MIN up to CC_CAL_MAX while the results don't change and
+** drops back to the minimum when they do, a sign that the
+** temperature has moved.
+**
+** This follows the CC1101 datasheet (SWRS061):
+**  - "Frequency Synthesizer Calibration": with FS_AUTOCAL=0 the
+**    synthesizer only calibrates on SCAL, and FSCAL3..1 keep the
+**    results. They stay valid while the temperature and supply
+**    voltage don't move much, and on one channel they never need
+**    changing for frequency.
+**  - The "Complete Radio Control State Diagram" has SRX taking
+**    TX straight to RX, the same path TXOFF_MODE=RX takes.
+** That direct turn has only been checked with the host model so
+** RX is entered from IDLE unless CC_TURN_DIRECT is defined.
+*/
+#if !defined(CC_CAL_MIN)
+  #define CC_CAL_MIN   60000UL   // ms between calibrations, 1 minute
+#endif
+#if !defined(CC_CAL_MAX)
+  #define CC_CAL_MAX  960000UL   // 16 minutes
+#endif
+
+static struct cc_cal {
+  uint8_t fscal[3];    // FSCAL3..1
+  uint32_t last;       // ms at the last calibration
+  uint32_t interval;
+} cal;
+
+void cc_calibrate( uint32_t now ) {
+  uint8_t i, same = ( cal.interval!=0 );
+
+  hal_gdo2_int_disable();       // Disable interrupts
+
+  while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
+  spi_strobe( CC1100_SCAL );
+  while ( ( cc_read( CC1100_MARCSTATE ) & 0x1F ) != CC_MARCSTATE_IDLE );
+
+  for( i=0 ; i<sizeof(cal.fscal) ; i++ ) {
+    uint8_t fscal = cc_read( CC1100_FSCAL3 + i );
+    if( fscal != cal.fscal[i] ) same = 0;
+    cal.fscal[i] = fscal;
+  }
+
+  if( !same )
+    cal.interval = CC_CAL_MIN;
+  else if( cal.interval < CC_CAL_MAX )
+    cal.interval <<= 1;
+  if( cal.interval > CC_CAL_MAX )
+    cal.interval = CC_CAL_MAX;
+  cal.last = now;
+
+  hal_gdo2_int_ack();          // Acknowledge any  previous edges
+}
+
+uint8_t cc_cal_due( uint32_t now ) {
+  return ( now - cal.last ) >= cal.interval;
+}
+
 void cc_enter_idle_mode(void) {
-  EIMSK &= ~INT_MASK;            // Disable interrupts
+  hal_gdo2_int_disable();       // Disable interrupts
 
   while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
 
-  EIFR  |= INT_MASK;          // Acknowledge any  previous edges
+  hal_gdo2_int_ack();          // Acknowledge any  previous edges
 }
 
 void cc_enter_rx_mode(void) {
-  EIMSK &= ~INT_MASK;            // Disable interrupts
+  hal_gdo2_int_disable();       // Disable interrupts
 
+#if defined(CC_MODE_VALUES)
+  // Registers are changed and the FIFO flushed in IDLE
   while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
+  cc_write_regs( CC_RX_VALUES, sizeof(CC_RX_VALUES) );
   spi_strobe( CC1100_SFRX );
+#elif !defined(CC_TURN_DIRECT)
+  while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
+#endif
+  // CC_TURN_DIRECT goes straight from TX, see the state diagram above
   while ( CC_STATE( spi_strobe( CC1100_SRX ) ) != CC_STATE_RX );
 
-  EIFR  |= INT_MASK;          // Acknowledge any  previous edges
+  hal_gdo2_int_ack();          // Acknowledge any  previous edges
 }
 
 void cc_enter_tx_mode(void) {
-  EIMSK &= ~INT_MASK;            // Disable interrupts
+  hal_gdo2_int_disable();       // Disable interrupts
 
   while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
+#if defined(CC_MODE_VALUES)
+  cc_write_regs( CC_TX_VALUES, sizeof(CC_TX_VALUES) );
+#endif
+#if defined(UART_TX_FIFO)
+  // The FIFO engine starts TX once it has loaded the FIFO
+  spi_strobe( CC1100_SFTX );
+  while ( CC_STATE( spi_strobe( CC1100_SFSTXON ) ) != CC_STATE_FSTXON );
+#else
   spi_strobe( CC1100_SFSTXON );
   while ( CC_STATE( spi_strobe( CC1100_STX ) ) != CC_STATE_TX );
+#endif
+
+  hal_gdo2_int_ack();          // Acknowledge any  previous edges
+}
+
+#if defined(UART_RX_FIFO)
+/***************************************************************
+** RX FIFO access, called from the FIFO engine's ISR
+*/
+
+// Start looking for the sync word again
+void cc_rx_restart(void) {
+  while ( CC_STATE( spi_strobe( CC1100_SIDLE ) ) != CC_STATE_IDLE );
+  spi_strobe( CC1100_SFRX );
+  while ( CC_STATE( spi_strobe( CC1100_SRX ) ) != CC_STATE_RX );
+}
+
+// Read the RX FIFO into buffer, returns the number of bytes read
+// or CC_RX_OVERFLOW
+uint8_t cc_read_fifo( uint8_t *buffer, uint8_t size ) {
+  uint8_t n, check;
+
+  // CC1101 Errata: RXBYTES must be read until it's stable
+  // and the last byte left until the packet has ended
+  n = cc_read( CC1100_RXBYTES );
+  do {
+    check = n;
+    n = cc_read( CC1100_RXBYTES );
+  } while( n != check );
+
+  if( n & CC_RX_OVERFLOW )
+    return CC_RX_OVERFLOW;
+
+  if( n ) n--;
+  if( n > size ) n = size;
+
+  if( n ) {
+    spi_assert();
+    while( spi_check_miso() );
+
+    spi_send( CC1100_RXFIFO | CC_READ );
+    for( check=0 ; check<n ; check++ )
+      buffer[check] = spi_send( 0 );
+
+    spi_deassert();
+  }
+
+  return n;
+}
+#endif
+
+#if defined(UART_TX_FIFO)
+/***************************************************************
+** TX FIFO access, called by the FIFO engine
+*/
+void cc_write_fifo( uint8_t *buffer, uint8_t n ) {
+  uint8_t i;
+
+  spi_assert();
+  while( spi_check_miso() );
+
+  spi_send( CC1100_TXFIFO );
+  for( i=0 ; i<n ; i++ )
+    spi_send( buffer[i] );
+
+  spi_deassert();
+}
+
+void cc_tx_start(void) {
+  while ( CC_STATE( spi_strobe( CC1100_STX ) ) != CC_STATE_TX );
+}
+
+// The packet ends once the radio has sent this many bytes (modulo 256)
+void cc_tx_end( uint8_t len ) {
+  cc_write( CC1100_PKTLEN, len );
+  cc_write( CC1100_PKTCTRL0, 0x00 );  // Fixed packet length
+}
 
-  EIFR  |= INT_MASK;          // Acknowledge any  previous edges
+// Radio has finished sending the packet
+uint8_t cc_tx_done(void) {
+  uint8_t marcstate = cc_read( CC1100_MARCSTATE ) & 0x1F;
+  return ( marcstate==CC_MARCSTATE_IDLE || marcstate==CC_MARCSTATE_TXFIFO_UNDERFLOW );
 }
+#endif
 
 uint8_t cc_read_rssi(void) {
   // CC1101 Section 17.3
@@ -131,6 +359,12 @@ uint8_t cc_read_rssi(void) {
   return (uint8_t)( -rssi ); // returns 10 to 138
 }
 
+// Only valid in RX
+// MCSM1 CCA_MODE makes this RSSI below threshold unless receiving a packet
+uint8_t cc_channel_clear(void) {
+  return ( cc_read( CC1100_PKTSTATUS ) & CC_PKTSTATUS_CCA );
+}
+
 void cc_init(void) {
   spi_init();
 
@@ -146,11 +380,7 @@ void cc_init(void) {
   spi_strobe(CC1100_SRES);
   //spi_strobe(CC1100_SCAL);
 
-  for (uint8_t i = 0; i < sizeof(CC_REGISTER_VALUES); ) {
-    uint8_t reg = pgm_read_byte(&CC_REGISTER_VALUES[i++]);
-    uint8_t val = pgm_read_byte(&CC_REGISTER_VALUES[i++]);
-    cc_write(reg, val);
-  }
+  cc_write_regs( CC_REGISTER_VALUES, sizeof(CC_REGISTER_VALUES) );
 
-  cc_enter_idle_mode();
+  cc_calibrate( 0 );
 }
@@ -13,11 +13,28 @@
 #include <stdint.h>
 
 extern uint8_t cc_read_rssi(void);
+extern uint8_t cc_channel_clear(void);
 
 extern void cc_enter_idle_mode(void);
 extern void cc_enter_rx_mode(void);
 extern void cc_enter_tx_mode(void);
 
+extern void cc_calibrate( uint32_t now );
+extern uint8_t cc_cal_due( uint32_t now );
+
+#if defined(UART_RX_FIFO)
+#define CC_RX_OVERFLOW 0x80
+extern void cc_rx_restart(void);
+extern uint8_t cc_read_fifo( uint8_t *buffer, uint8_t size );
+#endif
+
+#if defined(UART_TX_FIFO)
+extern void cc_write_fifo( uint8_t *buffer, uint8_t n );
+extern void cc_tx_start(void);
+extern void cc_tx_end( uint8_t len );
+extern uint8_t cc_tx_done(void);
+#endif
+
 extern void cc_init(void);
 extern void cc_work(void);
 
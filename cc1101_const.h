@@ -112,4 +112,19 @@
 #define CC_STATE_RX_OVERFLOW  0x60
 #define CC_STATE_TX_UNDERFLOW 0x70
 
+// PKTSTATUS bits
+#define CC_PKTSTATUS_CS                0x40  // Carrier sense
+#define CC_PKTSTATUS_CCA               0x10  // Channel clear, MCSM1 CCA_MODE
+
+// MARCSTATE values
+#define CC_MARCSTATE_IDLE              0x01
+#define CC_MARCSTATE_MANCAL            0x05
+#define CC_MARCSTATE_STARTCAL          0x08
+#define CC_MARCSTATE_FS_LOCK           0x0A
+#define CC_MARCSTATE_RX                0x0D
+#define CC_MARCSTATE_RXFIFO_OVERFLOW   0x11
+#define CC_MARCSTATE_FSTXON            0x12
+#define CC_MARCSTATE_TX                0x13
+#define CC_MARCSTATE_TXFIFO_UNDERFLOW  0x16
+
 #endif // _CC1101_CONST_H_
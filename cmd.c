@@ -7,15 +7,19 @@
 #include <avr/pgmspace.h>
 
 #include <string.h>
-#include <stdio.h>
 
 #include "tty.h"
+#include "uart.h"
+#include "frame.h"
+#include "prof.h"
+#include "message.h"
+#include "fmt.h"
 
 #include "version.h"
 #include "cmd.h"
 
 static struct cmd {
-  char buffer[TXBUF];
+  char buffer[CMDBUF];
   uint8_t n;
   uint8_t inCmd;
 } command;
@@ -45,11 +49,16 @@ static uint8_t get_hex( uint8_t len, char *param ) {
 
 uint8_t trace0 = 0;// TRC_RAW;
 static uint8_t cmd_trace( struct cmd *cmd ) {
+  char *s = command.buffer;
 
   if( cmd->n > 1 )
     trace0 = get_hex( cmd->n-1, cmd->buffer+1 );
 
-  command.n = sprintf_P( command.buffer, PSTR("# !T=%02x\r\n"),trace0);
+  s += fmt_str_P( s, PSTR("# !T=") );
+  s += fmt_hex( s, trace0 );
+  s[-1] |= 0x20; s[-2] |= 0x20;  // Lower case, digits are unchanged
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
 
   return 1;
 }
@@ -57,8 +66,185 @@ static uint8_t cmd_trace( struct cmd *cmd ) {
 //------------------------------------------------------------------------
 
 static uint8_t cmd_version( struct cmd *cmd __attribute__((unused))) {
+  char *s = command.buffer;
+
   // There are no parameters
-  command.n = sprintf_P( command.buffer, PSTR("# %s %d.%d.%d\r\n"),BRANCH,MAJOR,MINOR,SUBVER);
+  s += fmt_str_P( s, PSTR("# " BRANCH " ") );
+  s += fmt_dec( s, MAJOR, 0 );
+  *(s++) = '.';
+  s += fmt_dec( s, MINOR, 0 );
+  *(s++) = '.';
+  s += fmt_dec( s, SUBVER, 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_uart( struct cmd *cmd ) {
+  char *s = command.buffer;
+
+  // !U0 resets the counters
+  if( cmd->n > 1 && cmd->buffer[1]=='0' )
+    uart_rx_stats_reset();
+
+  s += fmt_str_P( s, PSTR("# !U overrun=") );
+  s += fmt_dec( s, uart_rx_overruns(), 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_frame( struct cmd *cmd ) {
+  struct frame_rx_stats stats;
+  char *s = command.buffer;
+
+  // !F0 resets the counters
+  if( cmd->n > 1 && cmd->buffer[1]=='0' )
+    frame_rx_stats_reset();
+
+  frame_rx_stats( &stats );
+  s += fmt_str_P( s, PSTR("# !F fuzzy=") );
+  s += fmt_dec( s, stats.syncFuzzy, 0 );
+  s += fmt_str_P( s, PSTR(" saved=") );
+  s += fmt_dec( s, stats.syncSaved, 0 );
+  s += fmt_str_P( s, PSTR(" false=") );
+  s += fmt_dec( s, stats.syncFalse, 0 );
+  s += fmt_str_P( s, PSTR(" class=") );
+  s += fmt_dec( s, stats.syncClass, 0 );
+  s += fmt_str_P( s, PSTR(" lost=") );
+  s += fmt_dec( s, stats.syncLost, 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_lbt( struct cmd *cmd ) {
+  struct frame_lbt_stats stats;
+  char *s = command.buffer;
+
+  // !L0 resets the counters
+  if( cmd->n > 1 && cmd->buffer[1]=='0' )
+    frame_lbt_stats_reset();
+
+  frame_lbt_stats( &stats );
+  s += fmt_str_P( s, PSTR("# !L defer=") );
+  s += fmt_dec( s, stats.deferred, 0 );
+  s += fmt_str_P( s, PSTR(" refused=") );
+  s += fmt_dec( s, stats.refused, 0 );
+  s += fmt_str_P( s, PSTR(" clsn=") );
+  s += fmt_dec( s, stats.collisions, 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_duty( struct cmd *cmd ) {
+  struct frame_duty_stats stats;
+  char *s = command.buffer;
+
+  // !D0 resets the counters, not the budget
+  if( cmd->n > 1 && cmd->buffer[1]=='0' )
+    frame_duty_stats_reset();
+
+  frame_duty_stats( &stats );
+  s += fmt_str_P( s, PSTR("# !D left=") );
+  s += fmt_dec( s, stats.left, 0 );
+  s += fmt_str_P( s, PSTR(" defer=") );
+  s += fmt_dec( s, stats.deferred, 0 );
+  s += fmt_str_P( s, PSTR(" refused=") );
+  s += fmt_dec( s, stats.refused, 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_chain( struct cmd *cmd ) {
+  char *s = command.buffer;
+
+  // !Cn sends up to n queued frames back to back, !C1 one at a time
+  if( cmd->n > 1 ) {
+    char n = cmd->buffer[1];
+    if( n<'1' || n>'9' )
+      return 0;
+    frame_tx_burst( n-'0' );
+  }
+
+  s += fmt_str_P( s, PSTR("# !C=") );
+  s += fmt_dec( s, frame_tx_burst_size(), 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_binary( struct cmd *cmd ) {
+  char *s = command.buffer;
+
+  // !B1 selects the binary host protocol, !B0 text
+  if( cmd->n > 1 )
+    msg_binary( cmd->buffer[1]=='1' );
+
+  s += fmt_str_P( s, PSTR("# !B=") );
+  s += fmt_dec( s, msg_binary_mode(), 0 );
+  s += fmt_str_P( s, PSTR("\r\n") );
+  command.n = s - command.buffer;
+  return 1;
+}
+
+//------------------------------------------------------------------------
+
+static uint8_t cmd_prof( struct cmd *cmd ) {
+  char *s = command.buffer;
+#if defined(ISR_PROFILE)
+  struct prof_stats stats;
+  char param = ( cmd->n > 1 ) ? cmd->buffer[1] : '\0';
+  uint8_t hist = ( cmd->n > 2 && ( cmd->buffer[2] & ~( 'A'^'a' ) )=='H' );
+
+  if( param=='\0' ) {  // !P lists the ISRs
+    s += fmt_str_P( s, PSTR("# !P 0=GDO2 1=SW 2=OVF 3=TX 4=TTY 5=GDO0 6=UDRE\r\n") );
+  } else if( ( param & ~( 'A'^'a' ) )=='R' ) {  // !PR resets the counters
+    prof_reset();
+    s += fmt_str_P( s, PSTR("# !PR\r\n") );
+  } else if( prof_read( param-'0', &stats ) ) {
+    s += fmt_str_P( s, PSTR("# !P") );
+    *(s++) = param;
+    if( hist ) {  // !PnH histogram
+      uint8_t i;
+      *(s++) = 'H';
+      for( i=0 ; i<PROF_BUCKETS ; i++ ) {
+        *(s++) = ' ';
+        s += fmt_dec( s, stats.hist[i], 0 );
+      }
+    } else {
+      s += fmt_str_P( s, PSTR(" n=") );
+      s += fmt_dec( s, stats.count, 0 );
+      s += fmt_str_P( s, PSTR(" t=") );
+      s += fmt_dec( s, stats.total, 0 );
+      s += fmt_str_P( s, PSTR(" min=") );
+      s += fmt_dec( s, stats.min, 0 );
+      s += fmt_str_P( s, PSTR(" max=") );
+      s += fmt_dec( s, stats.max, 0 );
+    }
+    s += fmt_str_P( s, PSTR("\r\n") );
+  } else {
+    return 0;
+  }
+#else
+  (void)cmd;
+  s += fmt_str_P( s, PSTR("# !P off\r\n") );
+#endif
+  command.n = s - command.buffer;
   return 1;
 }
 
@@ -71,6 +257,13 @@ static uint8_t check_command( struct cmd *cmd ) {
     switch( cmd->buffer[0] & ~( 'A'^'a' ) ) {
     case 'V':  validCmd = cmd_version( cmd );       break;
     case 'T':  validCmd = cmd_trace( cmd );         break;
+    case 'U':  validCmd = cmd_uart( cmd );          break;
+    case 'F':  validCmd = cmd_frame( cmd );         break;
+    case 'L':  validCmd = cmd_lbt( cmd );           break;
+    case 'C':  validCmd = cmd_chain( cmd );         break;
+    case 'D':  validCmd = cmd_duty( cmd );          break;
+    case 'P':  validCmd = cmd_prof( cmd );          break;
+    case 'B':  validCmd = cmd_binary( cmd );        break;
     }
   }
 
@@ -93,7 +286,7 @@ uint8_t cmd( uint8_t byte, char **buffer, uint8_t *n ) {
         }
       }
     } else if ( byte >= ' ' ) { // Printable chararacter
-      if( command.n < TXBUF )
+      if( command.n < CMDBUF )
         command.buffer[ command.n++] = byte;
       else
         command.inCmd = 0;
@@ -10,6 +10,9 @@
 
 #define CMD '!'
 
+// Longest command or reply, replies are written to the tty in pieces
+#define CMDBUF 64
+
 extern uint8_t cmd( uint8_t byte, char **buffer, uint8_t *n );
 
 #endif // _CMD_H_
@@ -1,7 +1,27 @@
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
-#if defined ARDUINO_AVR_PRO
+// Define GDO2_ICP1 if GDO2 is wired to ICP1 (Arduino D8) rather than
+// its INTn pin. RX edges are then timestamped by the Timer1 input
+// capture unit instead of by software.
+//#define GDO2_ICP1
+
+// Define UART_RX_FIFO to receive through the CC1101 RX FIFO (fifo_uart.c)
+// instead of timing every edge of the signal on GDO2 (sw_uart.c).
+// GDO2 then signals the RX FIFO threshold.
+//#define UART_RX_FIFO
+
+// Define UART_TX_FIFO to transmit through the CC1101 TX FIFO (fifo_uart.c)
+// instead of clocking every bit out on GDO0 (sw_uart.c).
+// GDO0 then becomes an input signalling the TX FIFO threshold.
+//#define UART_TX_FIFO
+
+// Define ISR_PROFILE to time every ISR (prof.c), reported by the !P command
+//#define ISR_PROFILE
+
+#if defined HOST_BUILD
+  #include "host_pins.h"
+#elif defined ARDUINO_AVR_PRO
   #define GDO0 INT0
   #define GDO2 INT1
   #include "atm328_pins.h"
@@ -4,7 +4,7 @@
 #include <avr/wdt.h>
 #include <avr/boot.h>
 
-#include "config.h"
+#include "hal.h"
 #include "led.h"
 
 #include "spi.h"
@@ -13,6 +13,7 @@
 #include "frame.h"
 #include "message.h"
 #include "tty.h"
+#include "prof.h"
 
 void main_init(void) {
   uint8_t  myClass = 18;
@@ -39,6 +40,7 @@ void main_init(void) {
   cc_init();
   frame_init();
   msg_init( myClass, myId );
+  prof_init();
 
   sei();
 }
@@ -46,10 +48,22 @@ void main_init(void) {
 void main_work(void) {
   frame_work();
   msg_work();
-  tty_work();
 }
 
 #ifdef NEEDS_MAIN
+#if defined(HOST_BUILD)
+int main(int argc, char *argv[]) {
+  host_init( argc, argv );
+  main_init();
+
+  while( host_work() ) {
+    main_work();
+  }
+
+  host_report();
+  return 0;
+}
+#else
 int main(void) {
   main_init();
 
@@ -58,3 +72,4 @@ int main(void) {
   }
 }
 #endif
+#endif
@@ -0,0 +1,402 @@
+/***************************************************************
+** fifo_uart.c
+**
+** Alternative RX and TX engines to sw_uart.c, built with
+** UART_RX_FIFO and/or UART_TX_FIFO
+**
+** RX: The CC1101 looks for the sync word and fills its RX FIFO with
+** the bitstream that follows it. GDO2 is raised when the FIFO reaches
+** its threshold; the FIFO is then drained in a burst and the UART
+** framing (START bit, 8 data bits, STOP bit) removed here before the
+** bytes are passed on to the frame layer.
+**
+** This takes one interrupt for every 8 bytes in the FIFO instead of
+** one for every edge of the signal.
+**
+** TX: The frame is packed into the bitstream, UART framing included,
+** and loaded into the TX FIFO. GDO0 is raised when the FIFO falls below
+** its threshold and the FIFO is topped up again. The packet is switched
+** to fixed length once the whole frame has been loaded so the radio
+** stops when it has sent it.
+**
+** This takes one interrupt for every 31 bytes in the FIFO instead of
+** one for every bit.
+*/
+
+#include "hal.h"
+
+#if defined(UART_RX_FIFO) || defined(UART_TX_FIFO)
+
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "cc1101.h"
+#include "frame.h"
+#include "prof.h"
+#include "uart.h"
+#include "fifo_uart.h"
+
+#define DEBUG_ISR(_v)      DEBUG1(_v)
+#define DEBUG_EDGE(_v)     DEBUG2(_v)
+
+#define FIFO_BURST  16
+
+#endif
+
+#if defined(UART_RX_FIFO)
+
+// STOP bit, and any idle bits after it, before the next START bit
+#define MAX_SYNC_ZEROS  4
+#define MAX_IDLE_BITS  10
+
+#define TRAILER 0x35
+
+/***********************************************************************************
+** Bitstream state machine
+*/
+
+enum fifo_rx_states {
+  FRX_OFF,
+  FRX_SYNC1,  // Rest of SYNC1 (0x00) after the sync word
+  FRX_IDLE,   // STOP bit until the next START bit
+  FRX_DATA,   // 8 data bits, little-endian
+  FRX_STOP,   // Check the STOP bit
+};
+
+static struct fifo_rx_stats {
+  uint16_t overrun;   // RX FIFO overflows
+} rxStats;
+
+static struct fifo_rx_state {
+  uint8_t state;
+  uint8_t nBits;
+  uint8_t byte;
+  uint8_t restart;
+  uint8_t draining;
+
+  uint8_t fifo[FIFO_BURST];
+} rx;
+
+void fifo_rx_reset(void) {
+  memset( &rx, 0, sizeof(rx) );
+  rx.state = FRX_SYNC1;
+}
+
+static void fifo_rx_byte( uint8_t byte ) {
+  frame_rx_byte( byte );
+
+  // End of frame, wait for the next sync word
+  if( byte==TRAILER || byte==FRM_LOST_SYNC )
+    rx.restart = 1;
+}
+
+static void fifo_rx_bit( uint8_t bit ) {
+  switch( rx.state ) {
+  case FRX_SYNC1:
+    if( bit ) {
+      rx.state = FRX_IDLE;
+      rx.nBits = 0;
+    } else if( ++rx.nBits > MAX_SYNC_ZEROS ) {
+      rx.restart = 1;
+    }
+    break;
+
+  case FRX_IDLE:
+    if( !bit ) { // START bit
+      rx.state = FRX_DATA;
+      rx.nBits = 0;
+      rx.byte = 0;
+    } else if( ++rx.nBits > MAX_IDLE_BITS ) {
+      fifo_rx_byte( FRM_LOST_SYNC );
+    }
+    break;
+
+  case FRX_DATA:
+    rx.byte >>= 1;
+    if( bit ) rx.byte |= 0x80;
+    if( ++rx.nBits==8 )
+      rx.state = FRX_STOP;
+    break;
+
+  case FRX_STOP:
+    if( bit ) {
+      rx.state = FRX_IDLE;
+      rx.nBits = 0;
+      fifo_rx_byte( rx.byte );
+    } else { // Lost BYTE synch
+      fifo_rx_byte( FRM_LOST_SYNC );
+    }
+    break;
+  }
+}
+
+/***********************************************************************************
+** RX FIFO
+** The bitstream is big-endian in the FIFO
+*/
+static void fifo_rx_drain(void) {
+  uint8_t n;
+
+  do {
+    n = cc_read_fifo( rx.fifo, FIFO_BURST );
+
+    if( n==CC_RX_OVERFLOW ) {
+      rxStats.overrun++;
+      fifo_rx_byte( FRM_LOST_SYNC );
+    } else {
+      uint8_t i;
+      for( i=0 ; i<n && !rx.restart ; i++ ) {
+        uint8_t byte = rx.fifo[i];
+        uint8_t mask;
+        for( mask=0x80 ; mask && !rx.restart ; mask>>=1 )
+          fifo_rx_bit( byte & mask );
+      }
+    }
+
+    if( rx.restart ) {
+      cc_rx_restart();
+      fifo_rx_reset();
+      break;
+    }
+  } while( n==FIFO_BURST );
+}
+
+// GDO2 is raised when the RX FIFO reaches its threshold
+ISR(GDO2_INT_VECT) {
+  DEBUG_ISR(1);
+  PROF_ISR_ENTER();
+
+  if( HAL_GDO2_LEVEL() )
+    HAL_SW_INT_TRIGGER();
+
+  PROF_ISR_EXIT( PROF_GDO2 );
+  DEBUG_ISR(0);
+}
+
+ISR(SW_INT_VECT) {
+  // Only one instance may drain the FIFO.
+  if( rx.draining || rx.state==FRX_OFF )
+    return;
+  rx.draining = 1;
+
+  PROF_ISR_ENTER();
+
+  do {
+    // SPI transfers are slow, don't block interrupts
+    sei();
+
+    DEBUG_EDGE( 1 );
+    fifo_rx_drain();
+    DEBUG_EDGE( 0 );
+
+    // GDO2 may have been raised again while we were draining
+    cli();
+  } while( HAL_GDO2_LEVEL() && rx.state!=FRX_OFF );
+
+  rx.draining = 0;
+
+  PROF_ISR_EXIT( PROF_SW );
+}
+
+/***********************************************************************************
+** Interface to sw_uart.c
+*/
+void fifo_rx_init(void) {
+  fifo_rx_reset();
+  rx.state = FRX_OFF;
+
+  // Not needed for edges, but frame.c times TX backoff with it
+  hal_rx_clock_run();
+}
+
+void fifo_rx_start(void) {
+  uint8_t sreg = SREG;
+  cli();
+
+  hal_gdo2_int_enable();
+
+  // Configure SW interrupt for FIFO draining
+  hal_sw_int_init();
+
+  SREG = sreg;
+}
+
+void fifo_rx_stop(void) {
+  hal_gdo2_int_disable();
+  rx.state = FRX_OFF;
+}
+
+uint16_t uart_rx_overruns(void) {
+  uint16_t overrun;
+  uint8_t sreg = SREG;
+  cli();
+
+  overrun = rxStats.overrun;
+
+  SREG = sreg;
+  return overrun;
+}
+
+void uart_rx_stats_reset(void) {
+  uint8_t sreg = SREG;
+  cli();
+
+  memset( &rxStats, 0, sizeof(rxStats) );
+
+  SREG = sreg;
+}
+
+#endif // UART_RX_FIFO
+
+#if defined(UART_TX_FIFO)
+
+#define TX_FIFO_SIZE   64
+#define TX_FIFO_THR    33   // FIFOTHR=7
+#define TX_REFILL      ( TX_FIFO_SIZE - TX_FIFO_THR )
+
+/***********************************************************************************
+** Bitstream packing
+**
+** Bytes go on air little-endian between a START (SPACE) and STOP (MARK)
+** bit but the FIFO is sent big-endian so each byte is reversed.
+*/
+static uint8_t const bit_reverse[16] PROGMEM = {
+  0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+  0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF
+};
+#define BIT_REVERSE(_n) pgm_read_byte( bit_reverse+(_n) )
+
+// START bit, data bits and STOP bit, first bit on air in bit 9
+#define UART_FRAME(_b) ( ( (uint16_t)( ( BIT_REVERSE( (_b)&0xF )<<4 ) | BIT_REVERSE( (_b)>>4 ) )<<1 ) | 1 )
+
+enum fifo_tx_states {
+  FTX_OFF,
+  FTX_SEND,   // Packing the frame
+  FTX_LAST,   // All of the frame is in the FIFO
+};
+
+static struct fifo_tx_state {
+  uint8_t  state;
+  uint8_t  nBits;
+  uint32_t bits;
+  uint16_t nFifo;   // Bytes loaded into the FIFO
+
+  uint8_t fifo[FIFO_BURST];
+} tx;
+
+void fifo_tx_reset(void) {
+  memset( &tx, 0, sizeof(tx) );
+  tx.state = FTX_SEND;
+}
+
+static uint8_t fifo_tx_pack( uint8_t *buffer, uint8_t size ) {
+  uint8_t n = 0;
+
+  // Leaves room for padding at the end of the frame
+  while( n+2 < size && tx.state==FTX_SEND ) {
+    if( tx.nBits < 8 ) {
+      uint8_t byte = frame_tx_byte();
+
+      if( !frame_tx_end() ) {
+        tx.bits = ( tx.bits<<10 ) | UART_FRAME( byte );
+        tx.nBits += 10;
+      } else {
+        // Pad the last byte with MARK
+        if( tx.nBits ) {
+          tx.bits = ( tx.bits<<( 8-tx.nBits ) ) | ( 0xFF>>tx.nBits );
+          tx.nBits = 8;
+        }
+        tx.state = FTX_LAST;
+      }
+    }
+
+    while( tx.nBits >= 8 && n < size ) {
+      tx.nBits -= 8;
+      buffer[n++] = (uint8_t)( tx.bits>>tx.nBits );
+    }
+  }
+
+  // A packet length of 0 would never end
+  if( tx.state==FTX_LAST && ( (uint8_t)( tx.nFifo+n ) )==0 )
+    buffer[n++] = 0xFF;
+
+  return n;
+}
+
+/***********************************************************************************
+** TX FIFO
+*/
+static void fifo_tx_fill( uint8_t space ) {
+  while( space && tx.state==FTX_SEND ) {
+    uint8_t n = fifo_tx_pack( tx.fifo, ( space < FIFO_BURST ) ? space : FIFO_BURST );
+
+    if( !n ) break;
+
+    cc_write_fifo( tx.fifo, n );
+    tx.nFifo += n;
+    space -= n;
+
+    if( tx.state==FTX_LAST )
+      cc_tx_end( (uint8_t)tx.nFifo );
+  }
+}
+
+// GDO0 is raised when the TX FIFO falls below its threshold
+ISR(GDO0_INT_VECT) {
+  DEBUG_ISR(1);
+  PROF_ISR_ENTER();
+
+  // SPI transfers are slow, don't block interrupts
+  hal_gdo0_int_disable();
+
+  do {
+    sei();
+    fifo_tx_fill( TX_REFILL );
+    cli();
+  } while( tx.state==FTX_SEND && HAL_GDO0_LEVEL() );
+
+  if( tx.state==FTX_SEND )
+    hal_gdo0_int_enable();
+
+  PROF_ISR_EXIT( PROF_GDO0 );
+  DEBUG_ISR(0);
+}
+
+/***********************************************************************************
+** Interface to sw_uart.c
+*/
+void fifo_tx_init(void) {
+  fifo_tx_reset();
+  tx.state = FTX_OFF;
+}
+
+void fifo_tx_start(void) {
+  fifo_tx_fill( TX_FIFO_SIZE );
+  cc_tx_start();
+
+  if( tx.state==FTX_SEND ) {
+    uint8_t sreg = SREG;
+    cli();
+
+    hal_gdo0_int_enable();
+
+    SREG = sreg;
+  }
+}
+
+void fifo_tx_stop(void) {
+  hal_gdo0_int_disable();
+  tx.state = FTX_OFF;
+}
+
+uint8_t fifo_tx_busy(void) {
+  switch( tx.state ) {
+  case FTX_SEND: return 1;
+  case FTX_LAST: return !cc_tx_done();
+  }
+  return 0;
+}
+
+#endif // UART_TX_FIFO
@@ -0,0 +1,23 @@
+/***************************************************************
+** fifo_uart.h
+**
+** RX and TX through the CC1101 FIFOs
+** Used by sw_uart.c when built with UART_RX_FIFO/UART_TX_FIFO
+*/
+#ifndef _FIFO_UART_H_
+#define _FIFO_UART_H_
+
+#include <stdint.h>
+
+extern void fifo_rx_init(void);
+extern void fifo_rx_reset(void);
+extern void fifo_rx_start(void);
+extern void fifo_rx_stop(void);
+
+extern void fifo_tx_init(void);
+extern void fifo_tx_reset(void);
+extern void fifo_tx_start(void);
+extern void fifo_tx_stop(void);
+extern uint8_t fifo_tx_busy(void);
+
+#endif // _FIFO_UART_H_
@@ -0,0 +1,71 @@
+/**************************************************************************
+** fmt.c
+**
+** Text formatting for the host tty without printf
+**
+** Decimal digits are found by repeated subtraction of powers
+** of ten. A digit never needs more than 9 so this is cheaper
+** than a 32 bit division on the AVR.
+*/
+#include <avr/pgmspace.h>
+
+#include "fmt.h"
+
+static char const hex_digits[16] PROGMEM = "0123456789ABCDEF";
+
+uint8_t fmt_hex( char *str, uint8_t byte ) {
+  str[0] = pgm_read_byte( hex_digits + ( byte >> 4 ) );
+  str[1] = pgm_read_byte( hex_digits + ( byte & 0x0F ) );
+
+  return 2;
+}
+
+uint8_t fmt_dec3( char *str, uint8_t value ) {
+  char digit;
+
+  digit = '0';
+  while( value >= 100 ) { value -= 100; digit++; }
+  str[0] = digit;
+
+  digit = '0';
+  while( value >= 10 ) { value -= 10; digit++; }
+  str[1] = digit;
+
+  str[2] = '0' + value;
+
+  return 3;
+}
+
+#define N_POWERS 10
+static uint32_t const powers[N_POWERS] PROGMEM = {
+  1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1
+};
+
+uint8_t fmt_dec( char *str, uint32_t value, uint8_t width ) {
+  uint8_t n = 0;
+  uint8_t i;
+
+  if( width==0 ) width = 1;
+  for( i=0 ; i<N_POWERS ; i++ ) {
+    uint32_t power = pgm_read_dword( powers + i );
+    char digit = '0';
+
+    while( value >= power ) { value -= power; digit++; }
+
+    // Leading zeros only to make up the width
+    if( n || digit!='0' || i >= N_POWERS-width )
+      str[n++] = digit;
+  }
+
+  return n;
+}
+
+uint8_t fmt_str_P( char *str, PGM_P s ) {
+  uint8_t n = 0;
+  char c;
+
+  while( ( c = pgm_read_byte( s + n ) ) )
+    str[n++] = c;
+
+  return n;
+}
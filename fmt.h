@@ -0,0 +1,19 @@
+/**************************************************************************
+** fmt.h
+**
+** Text formatting for the host tty without printf
+*/
+#ifndef _FMT_H_
+#define _FMT_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+// Each writes its text at str and returns the number of characters
+// The text is not terminated
+extern uint8_t fmt_hex( char *str, uint8_t byte );                   // 2 upper case hex digits
+extern uint8_t fmt_dec3( char *str, uint8_t value );                 // 3 digits, zero padded
+extern uint8_t fmt_dec( char *str, uint32_t value, uint8_t width );  // at least width digits, zero padded
+extern uint8_t fmt_str_P( char *str, PGM_P s );
+
+#endif // _FMT_H_
@@ -5,6 +5,7 @@
 #include <avr/pgmspace.h>
 
 #include "config.h"
+#include "hal.h"
 #include "message.h"
 #include "uart.h"
 #include "cc1101.h"
@@ -32,6 +33,48 @@ static void frame_reset(void) {
   memset( &frame, 0, sizeof(frame) );
 }
 
+/*******************************************************
+** Clocks
+**
+** Frame timing uses the RX clock, 2MHz ticks that wrap
+** every 32ms. frame_ms() extends it to milliseconds so
+** it must be called more often than that. frame_work()
+** calls it on every pass.
+*/
+#define FRAME_MS_TICKS 2000
+
+static uint16_t frame_clock(void) {
+  uint16_t now;
+  uint8_t sreg = SREG;
+  cli();
+
+  now = HAL_RX_CLOCK();
+
+  SREG = sreg;
+  return now;
+}
+
+static struct frame_time {
+  uint16_t last;
+  uint16_t ticks;   // Part of a millisecond left over
+  uint32_t ms;
+} msTime;
+
+uint32_t frame_ms(void) {
+  uint16_t now = frame_clock();
+  uint16_t elapsed = now - msTime.last;
+
+  msTime.last = now;
+  msTime.ms += elapsed / FRAME_MS_TICKS;
+  msTime.ticks += elapsed % FRAME_MS_TICKS;
+  if( msTime.ticks >= FRAME_MS_TICKS ) {
+    msTime.ticks -= FRAME_MS_TICKS;
+    msTime.ms++;
+  }
+
+  return msTime.ms;
+}
+
 /*******************************************************
 * Manchester Encoding
 *
@@ -68,28 +111,37 @@ static uint8_t const man_encode[16] PROGMEM = {
 #define MAN_ENCODE(_i) pgm_read_byte( man_encode+(_i) )
 
 // Convert little-endian 4 bits to 2-bit big endian
-static uint8_t const man_decode[16] PROGMEM = {
-  0xF, 0xF, 0xF, 0xF, 0xF, 0x3, 0x2, 0xF,
-  0xF, 0x1, 0x0, 0xF, 0xF, 0xF, 0xF, 0xF
+#define MAN_BITS(_n)   ( ( (_n)==0x5 ) ? 0x3 : ( (_n)==0x6 ) ? 0x2 \
+                       : ( (_n)==0x9 ) ? 0x1 : ( (_n)==0xA ) ? 0x0 : 0xF )
+
+// Convert a little-endian byte to 4-bit big endian in one lookup
+// Bytes that aren't a valid code have MAN_INVALID set
+#define MAN_INVALID    0x10
+#define MAN_CODE(_b)   ( ( MAN_BITS( (_b)>>4 )==0xF || MAN_BITS( (_b)&0xF )==0xF ) ? MAN_INVALID \
+                       : ( MAN_BITS( (_b)>>4 )<<2 ) | MAN_BITS( (_b)&0xF ) )
+#define MAN_CODE4(_b)  MAN_CODE(_b), MAN_CODE(_b+1), MAN_CODE(_b+2), MAN_CODE(_b+3)
+#define MAN_CODE16(_b) MAN_CODE4(_b), MAN_CODE4(_b+4), MAN_CODE4(_b+8), MAN_CODE4(_b+12)
+
+static uint8_t const man_decode[256] PROGMEM = {
+  MAN_CODE16( 0x00 ), MAN_CODE16( 0x10 ), MAN_CODE16( 0x20 ), MAN_CODE16( 0x30 ),
+  MAN_CODE16( 0x40 ), MAN_CODE16( 0x50 ), MAN_CODE16( 0x60 ), MAN_CODE16( 0x70 ),
+  MAN_CODE16( 0x80 ), MAN_CODE16( 0x90 ), MAN_CODE16( 0xA0 ), MAN_CODE16( 0xB0 ),
+  MAN_CODE16( 0xC0 ), MAN_CODE16( 0xD0 ), MAN_CODE16( 0xE0 ), MAN_CODE16( 0xF0 )
 };
-#define MAN_DECODE(_i) pgm_read_byte( man_decode+(_i) )
+#define MAN_DECODE(_b) pgm_read_byte( man_decode+(_b) )
 
-static inline int manchester_code_valid( uint8_t code ) {
- return ( MAN_DECODE( (code>>4)&0xF )!=0xF ) && ( MAN_DECODE( (code   )&0xF )!=0xF ) ;
+// Both bytes of the pair that encodes a byte
+void frame_man_encode( uint8_t *raw, uint8_t byte ) {
+  raw[0] = MAN_ENCODE( byte >> 4 );
+  raw[1] = MAN_ENCODE( byte & 0xF );
 }
 
-static inline uint8_t manchester_decode( uint8_t byte ) {
-  uint8_t decoded;
-
-  decoded  = MAN_DECODE( ( byte    ) & 0xF );
-  decoded |= MAN_DECODE( ( byte>>4 ) & 0xF )<<2;
+// The byte a pair encodes, over 0xFF if either isn't a valid code
+uint16_t frame_man_decode( uint8_t const *raw ) {
+  uint8_t hi = MAN_DECODE( raw[0] );
+  uint8_t lo = MAN_DECODE( raw[1] );
 
-  return decoded;
-}
-
-static inline uint8_t manchester_encode( uint8_t value ) {
-  return MAN_ENCODE(value & 0xF )
-  ;
+  return ( ( hi | lo ) & MAN_INVALID ) ? 0x100 : ( hi<<4 ) | lo;
 }
 
 /***********************************************************************************
@@ -101,10 +153,20 @@ static inline uint8_t manchester_encode( uint8_t value ) {
 ** <trailer>  is a single byte (not a valid manchester code value) that marks end of packet
 */
 
+// Raw bytes checked before a message buffer is taken
+// The message header and the class of the first address
+#define PROBE_BYTES 4
+
+// Header bit errors accepted in the first bytes after the sync word
+#if !defined(FRM_SYNC_ERRS)
+  #define FRM_SYNC_ERRS 2
+#endif
+
 enum frame_rx_states {
   FRM_RX_OFF,
   FRM_RX_IDLE,
   FRM_RX_SYNCH,
+  FRM_RX_PROBE,
   FRM_RX_MESSAGE,
   FRM_RX_DONE,
   FRM_RX_ABORT
@@ -118,10 +180,15 @@ static struct frame_rx {
   uint8_t *raw;
 
   uint32_t syncBuffer;
+  uint8_t nSync;
+  uint8_t fuzzy;
+  uint8_t probe[PROBE_BYTES];
 
   uint8_t count;
   uint8_t msgErr;
   uint8_t msgByte;
+
+  uint16_t end;     // RX clock when the frame ended
 } rxFrm;
 
 static void frame_rx_reset(void) {
@@ -132,34 +199,165 @@ static uint8_t evo_hdr[] = { 0x33, 0x55, 0x53 };
 static uint8_t evo_tlr[] = { 0x35 };
 static uint32_t syncWord;
 
+static struct frame_rx_stats rxFrmStats;
+static struct frame_lbt_stats lbtStats;
+
+/*******************************************************
+* Header correlation
+*
+* A header that doesn't match exactly is still accepted
+* if it is one of the first windows after the sync word
+* and is within FRM_SYNC_ERRS bit errors of evo_hdr.
+*
+* The edges of each byte are decoded on their own, so an
+* interval misjudged by a bit shifts the rest of that byte
+* by one bit position. The next byte is unaffected.
+* A header byte that slipped like this costs one error
+* plus any errors in its remaining bits.
+*
+* Manchester codes are at least 2 errors from 0x33 even
+* when slipped so the window stops before the message.
+*/
+#define SYNC_WINDOWS 2    // Header in place or one byte late
+
+static uint8_t const nibble_bits[16] PROGMEM = {
+  0, 1, 1, 2, 1, 2, 2, 3,  1, 2, 2, 3, 2, 3, 3, 4
+};
+#define BITS(_b) ( pgm_read_byte( nibble_bits+( (_b)&0xF ) ) + pgm_read_byte( nibble_bits+( (_b)>>4 ) ) )
+
+static uint8_t sync_byte_errs( uint8_t byte, uint8_t hdr ) {
+  uint8_t errs = BITS( byte ^ hdr );
+
+  if( errs > 1 ) {
+    uint8_t slip;
+
+    slip = 1 + BITS( (uint8_t)( byte ^ ( hdr<<1 ) ) & 0xFE );  // Extra bit
+    if( slip < errs ) errs = slip;
+
+    slip = 1 + BITS( ( byte ^ ( hdr>>1 ) ) & 0x7F );            // Missing bit
+    if( slip < errs ) errs = slip;
+  }
+
+  return errs;
+}
+
+static uint8_t sync_errs( uint32_t window ) {
+  uint8_t errs = 0;
+  uint8_t i = sizeof(evo_hdr);
+
+  while( i-- && errs<=FRM_SYNC_ERRS ) {
+    errs += sync_byte_errs( (uint8_t)window, evo_hdr[i] );
+    window >>= 8;
+  }
+
+  return errs;
+}
+
+/*******************************************************
+* Message probe
+*
+* Most syncs in noise are false and a message buffer
+* is too scarce to spend on each one. The first bytes
+* after the header are decoded here and the message is
+* only started when they look like a real one.
+* A false sync restarts RX without a message.
+*/
+static void frame_rx_false_sync(void) {
+  rxFrmStats.syncFalse++;
+  frame_rx_reset();
+}
+
+static void frame_rx_probe( uint8_t byte ) {
+  uint8_t decoded = MAN_DECODE( byte );
+  uint8_t i;
+
+  // A collision or lost sync is not a false header
+  if( byte==0x00 ) {
+    lbtStats.collisions++;
+    frame_rx_reset();
+    return;
+  }
+  if( byte==FRM_LOST_SYNC ) {
+    rxFrmStats.syncLost++;
+    frame_rx_reset();
+    return;
+  }
+
+  if( decoded & MAN_INVALID ) {
+    frame_rx_false_sync();
+    return;
+  }
+
+  rxFrm.probe[rxFrm.nBytes++] = byte;
+  rxFrm.msgByte = ( rxFrm.msgByte<<4 ) | decoded;
+  if( rxFrm.nBytes & 1 )
+    return;
+
+  if( rxFrm.nBytes==2 ) {
+    if( !msg_rx_header_valid( rxFrm.msgByte ) )
+      frame_rx_false_sync();
+    return;
+  }
+
+  if( !msg_rx_class_valid( rxFrm.msgByte ) ) {
+    rxFrmStats.syncClass++;
+    frame_rx_false_sync();
+    return;
+  }
+
+  rxFrm.raw = msg_rx_start();
+  rxFrm.nRaw = rxFrm.raw[0];
+  rxFrm.state = FRM_RX_MESSAGE;
+  DEBUG_FRAME(1);
+
+  // Catch the message up with the probe
+  for( i=0 ; i<PROBE_BYTES ; i+=2 ) {
+    rxFrm.raw[i]   = rxFrm.probe[i];
+    rxFrm.raw[i+1] = rxFrm.probe[i+1];
+    rxFrm.msgErr = msg_rx_byte( ( MAN_DECODE( rxFrm.probe[i] )<<4 ) | MAN_DECODE( rxFrm.probe[i+1] ) );
+    if( rxFrm.msgErr != MSG_OK ) {
+      rxFrm.state = FRM_RX_ABORT;
+      break;
+    }
+  }
+}
+
 void frame_rx_byte(uint8_t byte) {
   switch( rxFrm.state ) {
 
   case FRM_RX_IDLE:
-    rxFrm.syncBuffer = byte;
-    if( byte == evo_hdr[0] )
-      rxFrm.state = FRM_RX_SYNCH;
-    break;
+    rxFrm.syncBuffer = 0;
+    rxFrm.nSync = 0;
+    rxFrm.state = FRM_RX_SYNCH;
+    /* fallthrough */
 
   case FRM_RX_SYNCH:
-    rxFrm.syncBuffer <<= 8;
-  	if( ( byte==0x00 ) || ( byte==0xFF ) || ( rxFrm.syncBuffer & 0xFF000000 ) ) {
+  	if( ( byte==0x00 ) || ( byte==0xFF ) || ( byte==FRM_LOST_SYNC ) ) {
       rxFrm.state = FRM_RX_IDLE;
 	  break;
     }
 
-    rxFrm.syncBuffer |= byte;
-    if( rxFrm.syncBuffer == syncWord )
-    {
-      rxFrm.raw = msg_rx_start();
-      if( rxFrm.raw ) {
-        rxFrm.nRaw = rxFrm.raw[0];
-        rxFrm.state  = FRM_RX_MESSAGE;
-        DEBUG_FRAME(1);
-      }
+    rxFrm.syncBuffer = ( rxFrm.syncBuffer<<8 ) | byte;
+    if( rxFrm.nSync < sizeof(evo_hdr)+SYNC_WINDOWS )
+      rxFrm.nSync++;
+    if( rxFrm.nSync < sizeof(evo_hdr) )
+      break;
+
+    if( ( rxFrm.syncBuffer & 0x00FFFFFF ) != syncWord ) {
+      if( FRM_SYNC_ERRS==0 || rxFrm.nSync >= sizeof(evo_hdr)+SYNC_WINDOWS
+       || sync_errs( rxFrm.syncBuffer ) > FRM_SYNC_ERRS )
+        break;
+      rxFrm.fuzzy = 1;
+      rxFrmStats.syncFuzzy++;
     }
+
+    rxFrm.state = FRM_RX_PROBE;
 	break;
 
+  case FRM_RX_PROBE:
+    frame_rx_probe( byte );
+    break;
+
   case FRM_RX_MESSAGE:
     if( byte==0x00 ) {
       rxFrm.state = FRM_RX_ABORT;
@@ -170,14 +368,15 @@ void frame_rx_byte(uint8_t byte) {
     } else if( byte == evo_tlr[0] ) {
       rxFrm.state = FRM_RX_DONE;
     } else {
+      uint8_t decoded = MAN_DECODE( byte );
       rxFrm.raw[rxFrm.nBytes++] = byte;
 
-      if( !manchester_code_valid( byte ) ) {
+      if( decoded & MAN_INVALID ) {
         rxFrm.state = FRM_RX_ABORT;
         rxFrm.msgErr = MSG_MANC_ERR;
       } else {
         rxFrm.msgByte <<= 4;
-        rxFrm.msgByte |= manchester_decode( byte );
+        rxFrm.msgByte |= decoded;
         rxFrm.count = 1- rxFrm.count;
 
         if( !rxFrm.count ) {
@@ -191,7 +390,7 @@ void frame_rx_byte(uint8_t byte) {
   }
 
   // Protect raw data buffer
-  if( rxFrm.state > FRM_RX_SYNCH && rxFrm.state < FRM_RX_DONE ) {
+  if( rxFrm.state==FRM_RX_MESSAGE ) {
     if( rxFrm.nBytes >= rxFrm.nRaw ) {
       rxFrm.state = FRM_RX_ABORT;
       rxFrm.msgErr = MSG_OVERRUN_ERR;
@@ -199,6 +398,7 @@ void frame_rx_byte(uint8_t byte) {
   }
 
   if( rxFrm.state >= FRM_RX_DONE ) {
+    rxFrm.end = frame_clock();
     DEBUG_FRAME(0);
   }
 
@@ -208,15 +408,24 @@ static void frame_rx_done(void) {
   DEBUG_FRAME(1);
 
   // Reset rxFrm as quickly as possible after collision can pick up new frame header
+  // Bytes are ignored until frame_work() re-enables RX, after msg_rx_end()
+  // has taken the message, so the ISR can't start the next one over it
   uint8_t nBytes = rxFrm.nBytes;
   uint8_t msgErr = rxFrm.msgErr;
+  uint16_t end = rxFrm.end;
   uint8_t rssi;
 
+  if( rxFrm.fuzzy && msgErr==MSG_OK )
+    rxFrmStats.syncSaved++;
+  if( msgErr==MSG_CLSN_ERR )
+    lbtStats.collisions++;
+
   frame_rx_reset();
 
   // Now tell message about the end of frame
   rssi = cc_read_rssi();
   msg_rx_rssi( rssi );
+  msg_rx_time( frame_ms() - (uint16_t)( frame_clock() - end ) / FRAME_MS_TICKS );
   msg_rx_end(nBytes,msgErr);
 
   DEBUG_FRAME(0);
@@ -232,7 +441,23 @@ static void frame_rx_done(void) {
 **   <message> = < manchester encoded pairs of bytes >
 **   <suffix>  = <trailer><training>
 **
+** The message is sent from where message.c keeps it, already coded.
+**
+** In a burst the next frame's prefix follows the suffix straight away,
+** without leaving TX. Once a frame's message has been taken
+** frame_work() echoes it and msg_work() starts the next one while the
+** suffix goes out. The uart is given more training until the next
+** frame is ready, for up to TX_GAP RX clock ticks.
 */
+#if !defined(TX_BURST)
+#define TX_BURST  1       // Frames per TX session, 1 for no bursts
+#endif
+#if !defined(TX_GAP)
+#define TX_GAP    8000    // RX clock ticks, 4ms
+#endif
+#if !defined(TX_GAP_MIN)
+#define TX_GAP_MIN 0      // Training bytes before the next prefix
+#endif
 
 enum frame_tx_states {
   FRM_TX_OFF,
@@ -241,6 +466,7 @@ enum frame_tx_states {
   FRM_TX_PREFIX,
   FRM_TX_MESSAGE,
   FRM_TX_SUFFIX,
+  FRM_TX_GAP,
   FRM_TX_DONE
 };
 
@@ -248,13 +474,21 @@ static struct frame_tx {
   uint8_t state;
 
   uint8_t nBytes;
-  uint8_t nRaw;
   uint8_t *raw;
 
   uint8_t count;
-  uint8_t msgByte;
+
+  uint8_t sent;     // Message taken, waiting for msg_tx_done()
+  uint8_t nNext;    // Bytes of the next frame, given during the suffix
+  uint8_t *rawNext;
+  uint8_t nChain;   // Frames chained onto the first
+  uint8_t hold;     // Next frame is over the airtime budget, not chained
+  uint16_t gap;
+  uint16_t nAir;    // Bytes given to the uart this session
 } txFrm;
 
+static uint8_t txBurst = TX_BURST;
+
 static void frame_tx_reset(void) {
   memset( &txFrm, 0, sizeof(txFrm) );
 }
@@ -270,23 +504,130 @@ static uint8_t tx_suffix[] = {
   0x55, 0x55, 0x55,               // Training
 };
 
-void frame_tx_start( uint8_t *raw, uint8_t nRaw ) {
-  uint8_t i, done, byte;
+/***********************************************************************************
+** Airtime budget
+**
+** A token bucket holds the airtime TX may still use, in uart bytes.
+** It holds up to TX_DUTY_BURST minutes' worth of the TX_DUTY permille
+** budget and starts full. Each TX session is charged the bytes
+** frame_tx_byte() gave the uart.
+**
+** Over any hour TX can use what the bucket holds plus an hour of refill.
+** So the bucket refills, measured with the RX clock from frame_work(),
+** at the hour's budget less its capacity and that sum never exceeds
+** TX_DUTY. With the default a burst after a quiet spell is at most 3.6s
+** of air and sustained TX gets 0.9 of TX_DUTY.
+**
+** A frame the budget can't cover waits for it to refill, unless that
+** would take more than TX_DUTY_WAIT. Then it is refused and echoed with
+** MSG_DUTY_ERR so the host knows it wasn't sent.
+**
+** Time the main loop spends away from frame_work() for more than one
+** RX clock period (32ms) is lost, which only makes the budget smaller.
+*/
+#if !defined(TX_DUTY)
+#define TX_DUTY       10          // Permille of airtime, 1%
+#endif
+#if !defined(TX_DUTY_WAIT)
+#define TX_DUTY_WAIT  4000000UL   // RX clock ticks, 2s
+#endif
+#if !defined(TX_DUTY_BURST)
+#define TX_DUTY_BURST 6           // Minutes of budget the bucket holds
+#endif
+
+#if TX_DUTY_BURST >= 60
+#error TX_DUTY_BURST must be less than an hour
+#endif
+
+// Uart bytes of airtime, 10 bits at 38400 baud
+#define DUTY_HOUR     ( 13824UL * TX_DUTY )   // Per hour
+#define DUTY_MAX      ( DUTY_HOUR * TX_DUTY_BURST / 60 )
+
+// RX clock ticks to earn one byte, an hour is 7.2e9
+#define DUTY_TICKS    ( 7200000000ULL / ( DUTY_HOUR - DUTY_MAX ) )
+#define FRAME_BYTES(_n)  ( sizeof(tx_prefix) + (_n) + sizeof(tx_suffix) )
+
+static struct frame_duty {
+  uint16_t last;
+  uint32_t ticks;     // Towards the next byte
+  uint32_t bytes;     // Airtime left
+  uint8_t waiting;    // The ready frame has been counted as deferred
+} duty;
+
+static struct frame_duty_stats dutyStats;
+
+static void frame_duty_update(void) {
+  uint16_t now = frame_clock();
+
+  duty.ticks += (uint16_t)( now - duty.last );
+  duty.last = now;
+
+  if( duty.ticks >= DUTY_TICKS ) {
+    duty.bytes += duty.ticks / DUTY_TICKS;
+    duty.ticks %= DUTY_TICKS;
+    if( duty.bytes > DUTY_MAX )
+      duty.bytes = DUTY_MAX;
+  }
+}
+
+static void frame_duty_charge( uint16_t nAir ) {
+  duty.bytes = ( nAir < duty.bytes ) ? duty.bytes - nAir : 0;
+}
 
-  // Encode raw frame
-  for( i=0 ; i<nRaw+1 ; i+=2 ) {
-  	byte = msg_tx_byte(&done);
-	if( done ) break;
-	
-	raw[ i   ] = manchester_encode( byte >> 4 );
-	raw[ i+1 ] = manchester_encode( byte      );
+// Room for a frame of nBytes after what this session has sent so far
+static uint8_t frame_duty_ok( uint8_t nBytes ) {
+  uint16_t nAir;
+  uint8_t sreg = SREG;
+  cli();
+
+  nAir = txFrm.nAir;
+
+  SREG = sreg;
+  return ( nAir + FRAME_BYTES( nBytes ) <= duty.bytes );
+}
+
+static uint8_t frame_tx_allowed(void) {
+  uint32_t need = FRAME_BYTES( txFrm.nBytes );
+
+  if( need <= duty.bytes ) {
+    duty.waiting = 0;
+    return 1;
+  }
+
+  if( ( need - duty.bytes ) * DUTY_TICKS > TX_DUTY_WAIT ) {
+    dutyStats.refused++;
+    duty.waiting = 0;
+
+    msg_tx_end( txFrm.nBytes );
+    frame_tx_reset();
+    msg_tx_done( MSG_DUTY_ERR );
+  } else if( !duty.waiting ) {
+    dutyStats.deferred++;
+    duty.waiting = 1;
   }
 
-  txFrm.nBytes = i;
-  txFrm.raw = raw;
-  txFrm.nRaw = nRaw;
+  return 0;
+}
+
+void frame_tx_start( uint8_t *raw, uint8_t nBytes ) {
+  // During TX the frame goes next
+  if( frame.state==FRM_TX ) {
+    uint8_t hold = !frame_duty_ok( nBytes );
+    uint8_t sreg = SREG;
+    cli();
+
+    // The TX ISR reads them together in FRM_TX_GAP
+    txFrm.hold = hold;
+    txFrm.rawNext = raw;
+    txFrm.nNext = nBytes;
+
+    SREG = sreg;
+  } else {
+    txFrm.nBytes = nBytes;
+    txFrm.raw = raw;
 	
-  txFrm.state = FRM_TX_READY;
+    txFrm.state = FRM_TX_READY;
+  }
 }
 
 uint8_t frame_tx_byte(void) {
@@ -313,6 +654,7 @@ uint8_t frame_tx_byte(void) {
     } 
 
     msg_tx_end( txFrm.nBytes );
+    txFrm.sent = 1;
 
     txFrm.count = 0;
     txFrm.state = FRM_TX_SUFFIX;
@@ -324,19 +666,150 @@ uint8_t frame_tx_byte(void) {
       break;
     }
     txFrm.count = 0;
-    txFrm.state = FRM_TX_DONE;
+    if( txFrm.nChain+1 >= txBurst ) {
+      txFrm.state = FRM_TX_DONE;
+      break;
+    }
+    txFrm.gap = frame_clock();
+    txFrm.state = FRM_TX_GAP;
     // Fall through
 
+  case FRM_TX_GAP:
+#if TX_GAP_MIN > 0
+    if( txFrm.count >= TX_GAP_MIN )
+#endif
+    {
+      if( txFrm.nNext && !txFrm.hold ) {
+        txFrm.nBytes = txFrm.nNext;
+        txFrm.raw = txFrm.rawNext;
+        txFrm.nNext = 0;
+        txFrm.nChain++;
+        txFrm.count = 0;
+        byte = tx_prefix[txFrm.count++];
+        txFrm.state = FRM_TX_PREFIX;
+        break;
+      }
+      if( (uint16_t)( frame_clock() - txFrm.gap ) >= TX_GAP ) {
+        txFrm.state = FRM_TX_DONE;
+        break;
+      }
+    }
+    byte = 0x55;
+    if( txFrm.count < 0xFF )
+      txFrm.count++;
+    break;
+
   case FRM_TX_DONE:
     break;
   }
 
+  if( txFrm.state!=FRM_TX_DONE )
+    txFrm.nAir++;
+
   return byte;
 }
 
+// All of the frame has been taken by the uart
+uint8_t frame_tx_end(void) {
+  return ( txFrm.state >= FRM_TX_DONE );
+}
+
 static void frame_tx_done(void) {
-  msg_tx_done();
+  uint8_t *raw = txFrm.rawNext;
+  uint8_t nNext = txFrm.nNext;
+
+  frame_duty_charge( txFrm.nAir );
+
+  if( txFrm.sent )
+    msg_tx_done( MSG_OK );
   frame_tx_reset();
+
+  // Given too late to join the burst, it waits for the channel again
+  if( nNext ) {
+    txFrm.nBytes = nNext;
+    txFrm.raw = raw;
+    txFrm.state = FRM_TX_READY;
+  }
+}
+
+/***********************************************************************************
+** Listen before talk
+**
+** A frame that is ready waits while the radio reports the channel busy.
+** MCSM1 CCA_MODE makes PKTSTATUS CCA clear only while RSSI is below
+** threshold and no packet is being received.
+**
+** Each time the channel is found busy the backoff window doubles, up to
+** LBT_WINDOW_MAX slots, and TX waits a random number of slots within it.
+** It keeps deferring at that window. After LBT_MAX_DEFER deferrals,
+** about a second, the frame is refused and echoed with MSG_BUSY_ERR so
+** a stuck carrier can't hold TX off for good. Nothing is sent over one.
+**
+** The RX clock times the wait, LBT_SLOT*LBT_WINDOW_MAX must stay below
+** half its 32ms period.
+*/
+#if !defined(LBT_SLOT)
+#define LBT_SLOT       1000    // RX clock ticks, 500us
+#endif
+#if !defined(LBT_WINDOW_MAX)
+#define LBT_WINDOW_MAX 32      // Slots, a power of 2
+#endif
+#if !defined(LBT_MAX_DEFER)
+#define LBT_MAX_DEFER  128     // Up to 255
+#endif
+
+static struct frame_lbt {
+  uint16_t start;
+  uint16_t wait;
+  uint8_t window;
+  uint8_t nDefer;
+  uint16_t random;
+} lbt;
+
+// Galois LFSR stirred with the clock so units that defer together
+// don't pick the same slot
+static uint8_t frame_random(void) {
+  uint16_t r = lbt.random ^ frame_clock();
+
+  r = ( r>>1 ) ^ ( ( r & 1 ) ? 0xB400 : 0 );
+  lbt.random = r;
+
+  return (uint8_t)r;
+}
+
+static uint8_t frame_tx_clear(void) {
+  if( lbt.wait ) {
+    if( (uint16_t)( frame_clock() - lbt.start ) < lbt.wait )
+      return 0;
+    lbt.wait = 0;
+  }
+
+  if( !cc_channel_clear() ) {
+    if( lbt.nDefer < LBT_MAX_DEFER ) {
+      lbt.nDefer++;
+      lbtStats.deferred++;
+
+      lbt.window = ( lbt.window ) ? lbt.window<<1 : 2;
+      if( lbt.window > LBT_WINDOW_MAX )
+        lbt.window = LBT_WINDOW_MAX;
+
+      lbt.start = frame_clock();
+      lbt.wait = ( 1 + ( frame_random() & ( lbt.window-1 ) ) ) * LBT_SLOT;
+      return 0;
+    }
+    lbtStats.refused++;
+    lbt.nDefer = 0;
+    lbt.window = 0;
+
+    msg_tx_end( txFrm.nBytes );
+    frame_tx_reset();
+    msg_tx_done( MSG_BUSY_ERR );
+    return 0;
+  }
+
+  lbt.nDefer = 0;
+  lbt.window = 0;
+  return 1;
 }
 
 /***************************************************************************
@@ -352,13 +825,70 @@ static void frame_rx_enable(void) {
   rxFrm.state = FRM_RX_IDLE;
 }
 
+// Ready for the next frame while RX is already on
+static void frame_rx_rearm(void) {
+#if defined(UART_RX_FIFO)
+  // The FIFO engine restarts the radio itself at the end of a frame or
+  // when it loses sync, so only the deframer is re-armed. Restarting
+  // the radio here as well could flush the start of the next frame.
+  rxFrm.state = FRM_RX_IDLE;
+#else
+  frame_rx_enable();
+#endif
+}
+
 static void frame_tx_enable(void) {
   uart_disable();
   cc_enter_tx_mode();
+
+  // uart may start taking bytes straight away
+  txFrm.state = FRM_TX_IDLE;
   uart_tx_enable();
 
   frame.state = FRM_TX;
-  txFrm.state = FRM_TX_IDLE;
+}
+
+void frame_rx_stats( struct frame_rx_stats *stats ) {
+  uint8_t sreg = SREG;
+  cli();
+
+  *stats = rxFrmStats;
+
+  SREG = sreg;
+}
+
+void frame_rx_stats_reset(void) {
+  uint8_t sreg = SREG;
+  cli();
+
+  memset( &rxFrmStats, 0, sizeof(rxFrmStats) );
+
+  SREG = sreg;
+}
+
+void frame_tx_burst( uint8_t nFrames ) {
+  txBurst = ( nFrames ) ? nFrames : 1;
+}
+
+uint8_t frame_tx_burst_size(void) {
+  return txBurst;
+}
+
+void frame_duty_stats( struct frame_duty_stats *stats ) {
+  *stats = dutyStats;
+  stats->left = duty.bytes;
+}
+
+void frame_duty_stats_reset(void) {
+  memset( &dutyStats, 0, sizeof(dutyStats) );
+}
+
+void frame_lbt_stats( struct frame_lbt_stats *stats ) {
+  *stats = lbtStats;
+}
+
+void frame_lbt_stats_reset(void) {
+  memset( &lbtStats, 0, sizeof(lbtStats) );
 }
 
 void frame_disable(void) {
@@ -376,11 +906,18 @@ void frame_init(void) {
   frame_reset();
   uart_init();
 
+  duty.bytes = DUTY_MAX;
+  duty.last = frame_clock();
+  msTime.last = duty.last;
+
   frame.state = FRM_IDLE;
 }
 
 
 void frame_work(void) {
+  frame_duty_update();
+  frame_ms();
+
   switch( frame.state ) {
   case FRM_IDLE:
     if( rxFrm.state==FRM_RX_OFF ) {
@@ -393,16 +930,26 @@ void frame_work(void) {
       frame_rx_done();
     }
     if( rxFrm.state<=FRM_RX_IDLE ) {
-      if( txFrm.state==FRM_TX_READY ) {
+      if( txFrm.state==FRM_TX_READY && frame_tx_allowed() && frame_tx_clear() ) {
         frame_tx_enable();
-      } else if( rxFrm.state==FRM_RX_OFF ) {
+      } else if( cc_cal_due( frame_ms() ) ) {
+        // Between frames, not straight after TX when a reply may be on its way
+        uart_disable();
+        cc_calibrate( frame_ms() );
         frame_rx_enable();
+      } else if( rxFrm.state==FRM_RX_OFF ) {
+        frame_rx_rearm();
       }
     }
     break;
 
   case FRM_TX:
-    if( txFrm.state>=FRM_TX_DONE ) {
+    // The next frame can start once this one's echo is done
+    if( txFrm.sent ) {
+      txFrm.sent = 0;
+      msg_tx_done( MSG_OK );
+    }
+    if( txFrm.state>=FRM_TX_DONE && !uart_tx_busy() ) {
       frame_tx_done();
       frame_rx_enable();
     }
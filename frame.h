@@ -7,8 +7,47 @@
 #define FRM_END       0xFF
 extern void frame_rx_byte(uint8_t byte);
 
-extern void frame_tx_start(uint8_t *raw, uint8_t nRaw);
+extern void frame_tx_start( uint8_t *raw, uint8_t nBytes );
+extern void frame_man_encode( uint8_t *raw, uint8_t byte );
+extern uint16_t frame_man_decode( uint8_t const *raw );
 extern uint8_t frame_tx_byte(void);
+extern uint8_t frame_tx_end(void);
+
+// Frames sent back to back in one TX session
+extern void frame_tx_burst( uint8_t nFrames );
+extern uint8_t frame_tx_burst_size(void);
+
+// Milliseconds since startup, from the RX clock
+extern uint32_t frame_ms(void);
+
+// RX statistics
+struct frame_rx_stats {
+  uint16_t syncFuzzy;   // Headers accepted with bit errors
+  uint16_t syncSaved;   // Frames they gave without error
+  uint16_t syncFalse;   // Syncs rejected before taking a message buffer
+  uint16_t syncClass;   // Of those, rejected for the class of their first address
+  uint16_t syncLost;    // Syncs that lost bit sync before the message started
+};
+extern void frame_rx_stats( struct frame_rx_stats *stats );
+extern void frame_rx_stats_reset(void);
+
+// TX airtime budget
+struct frame_duty_stats {
+  uint32_t left;        // Bytes of airtime left
+  uint16_t deferred;    // Frames held until the budget refilled
+  uint16_t refused;     // Frames echoed with MSG_DUTY_ERR instead of sent
+};
+extern void frame_duty_stats( struct frame_duty_stats *stats );
+extern void frame_duty_stats_reset(void);
+
+// Listen before talk statistics
+struct frame_lbt_stats {
+  uint16_t deferred;    // Channel found busy when a frame was ready
+  uint16_t refused;     // Frames echoed with MSG_BUSY_ERR after LBT_MAX_DEFER deferrals
+  uint16_t collisions;  // Frames received that ended in a collision
+};
+extern void frame_lbt_stats( struct frame_lbt_stats *stats );
+extern void frame_lbt_stats_reset(void);
 
 extern void frame_disable(void);
 
@@ -0,0 +1,62 @@
+/***************************************************************
+** hal.h
+**
+** Hardware abstraction layer
+**
+** The radio UART emulation, CC1101 driver and host tty only touch
+** the hardware through this interface.
+**
+**  AVR  - hal_avr.h, hal_avr.c, spi.c
+**         Register access, inlined so ISR paths cost the same as
+**         direct register access
+**
+**  HOST - host/hal_host.h, host/hal_host.c, host/spi_host.c
+**         Linux simulation, built with HOST_BUILD and NEEDS_MAIN
+**         (see README.md)
+**
+** Interface
+**  RX edge clock (free-running, prescaled to 2 MHz)
+**    hal_rx_clock_init()       HAL_RX_CLOCK()
+**    hal_rx_clock_run()        (no overflow interrupt)
+**  GDO2 (RX data from radio)
+**    HAL_GDO2_LEVEL()          hal_gdo2_int_enable()
+**    hal_gdo2_int_disable()    hal_gdo2_int_ack()
+**  GDO2 edge timestamp (RX clock and level at the edge)
+**    HAL_GDO2_EDGE_TIME()      HAL_GDO2_EDGE_LEVEL()
+**    hal_gdo2_edge_next()
+**    With GDO2_ICP1 these come from the Timer1 input capture unit,
+**    otherwise the ISR samples the RX clock and pin itself.
+**  GDO0 (TX data to radio)
+**    HAL_GDO0_OUT(_bit)
+**  GDO0 (TX FIFO below threshold from radio, UART_TX_FIFO only)
+**    HAL_GDO0_LEVEL()          hal_gdo0_int_enable()
+**    hal_gdo0_int_disable()
+**  Software interrupt (edge analysis)
+**    hal_sw_int_init()         HAL_SW_INT_TRIGGER()
+**  TX bit clock (38400 baud)
+**    hal_tx_clock_init()       hal_tx_clock_start()
+**    hal_tx_clock_stop()
+**  Host tty USART
+**    hal_tty_init()
+**    hal_tty_tx_enable()       hal_tty_tx_disable()
+**    hal_tty_rx_enable()       hal_tty_rx_disable()
+**    HAL_TTY_TX_READY()        HAL_TTY_TX(_byte)
+**    HAL_TTY_RX_READY()        HAL_TTY_RX()
+**  ISR profiling clock (ISR_PROFILE only, ticks of HAL_PROF_CYCLES)
+**    hal_prof_clock_init()     HAL_PROF_CLOCK()
+**    HAL_PROF_CLOCK_EXIT()
+**  Pins
+**    hal_gdo_init()
+*/
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include "config.h"
+
+#if defined(HOST_BUILD)
+  #include "hal_host.h"
+#else
+  #include "hal_avr.h"
+#endif
+
+#endif // _HAL_H_
@@ -0,0 +1,58 @@
+/***************************************************************
+** hal_avr.c
+**
+** AVR backend of the hardware abstraction layer
+** Anything too big to be inlined in hal_avr.h
+*/
+#include "hal.h"
+
+#if !defined(HOST_BUILD)
+
+/**************************************************************************
+** Host tty USART
+*/
+void hal_tty_init( uint32_t Fosc, uint32_t bitrate )
+{
+  uint32_t ubrr_0, actual_0, error_0;
+  uint32_t ubrr_1, actual_1, error_1;
+
+  ubrr_0  = bitrate*8;  // Rounding adjustment
+  ubrr_0 += Fosc;
+  ubrr_0 /= 16;
+  ubrr_0 /= bitrate;
+  ubrr_0 -= 1;
+
+  actual_0  = Fosc / 16;
+  actual_0 /= ubrr_0+1;
+
+  ubrr_1  = bitrate*4;  // Rounding adjustment
+  ubrr_1 += Fosc;
+  ubrr_1 /= 8;
+  ubrr_1 /= bitrate;
+  ubrr_1 -= 1;
+
+  actual_1  = Fosc / 8;
+  actual_1 /= ubrr_1+1;
+
+  error_0 = ( actual_0 > bitrate ) ? actual_0 - bitrate : bitrate - actual_0;
+  error_1 = ( actual_1 > bitrate ) ? actual_1 - bitrate : bitrate - actual_1;
+  if( error_0 <= error_1 ) {  // Prefer U2X0=0
+    UCSR0A = 0;
+    UBRR0 = ubrr_0;
+  } else {
+    UCSR0A = ( 1 << U2X0 );
+    UBRR0 = ubrr_1;
+  }
+
+  UCSR0B = ( 0 << RXCIE0 ) | ( 0 << TXCIE0 ) | ( 0 << UDRIE0 )  // Interrupts disabled
+         | ( 0 << RXEN0  ) | ( 0 << TXEN0  )                    // RX+TX disabled
+         | ( 0 << UCSZ02 );                                     // 8 Bits
+
+  UCSR0C  = ( 0 << UMSEL01 ) | ( 0 << UMSEL00 )   // Asynchronous
+          | ( 0 << UPM01   ) | ( 0 << UPM00   )   // Parity disable
+          | ( 0 << USBS0   )                      // 1 stop bit
+          | ( 1 << UCSZ01  ) |  ( 1 << UCSZ00 )   // 8 data bits
+          | ( 0 << UCPOL0  );
+}
+
+#endif // !HOST_BUILD
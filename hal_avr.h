@@ -0,0 +1,238 @@
+/***************************************************************
+** hal_avr.h
+**
+** AVR backend of the hardware abstraction layer
+** Include hal.h instead of this file
+*/
+#ifndef _HAL_H_
+#  error "Include hal.h instead of this file"
+#endif
+
+#ifndef _HAL_AVR_H_
+#define _HAL_AVR_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/***************************************************************
+** RX edge clock
+** Timer1 free-running, pre-scaled by 8
+*/
+#define HAL_RX_CLOCK()  TCNT1
+
+static inline void hal_rx_clock_init(void) {
+  TCCR1A = 0; // Normal mode, no output pins
+
+  // We want to prescale the hardware timer as much as possible
+  // to maximise the period between overruns but remain above 500 KHz
+  TCCR1B = ( 1<<CS11 ); // Pre-scale by 8
+
+  TIMSK1 |= ( 1<<TOIE1 );
+}
+
+// Start the clock without its overflow interrupt, if it isn't running
+static inline void hal_rx_clock_run(void) {
+  if( !( TCCR1B & ( ( 1<<CS12 ) | ( 1<<CS11 ) | ( 1<<CS10 ) ) ) ) {
+    TCCR1A = 0;
+    TCCR1B = ( 1<<CS11 ); // Pre-scale by 8
+  }
+}
+
+/***************************************************************
+** ISR profiling clock
+** Shares Timer1 with the RX edge clock, 8 CPU cycles per tick
+*/
+#define HAL_PROF_CLOCK()       TCNT1
+#define HAL_PROF_CLOCK_EXIT()  TCNT1
+#define HAL_PROF_CYCLES        8
+
+static inline void hal_prof_clock_init(void) {
+  hal_rx_clock_run();
+}
+
+/***************************************************************
+** GDO2 - RX data from radio
+*/
+#define HAL_GDO2_LEVEL()  ( GDO2_PIN & GDO2_IN )
+
+#if defined(GDO2_ICP1)
+/***************************************************************
+** Timer1 input capture
+** ICR1 latches the RX clock on the edge itself so the timestamp
+** doesn't depend on how long the ISR took to run. Only one edge
+** polarity can be captured so it is toggled after every edge.
+*/
+#define HAL_GDO2_EDGE_TIME()   ICR1
+#define HAL_GDO2_EDGE_LEVEL()  ( TCCR1B & ( 1<<ICES1 ) ) // Rising edge was captured
+
+static inline void hal_gdo2_edge_next(void) {
+  TCCR1B ^= ( 1<<ICES1 );
+  TIFR1 = ( 1<<ICF1 );  // Changing ICES1 may set ICF1
+}
+
+static inline void hal_gdo2_int_enable(void) {
+  // Noise canceller on, capture the edge away from the current level
+  TCCR1B |= ( 1<<ICNC1 );
+  if( HAL_GDO2_LEVEL() )
+    TCCR1B &= ~( 1<<ICES1 );
+  else
+    TCCR1B |=  ( 1<<ICES1 );
+
+  TIFR1   = ( 1<<ICF1 );    // Acknowledge any previous edges
+  TIMSK1 |= ( 1<<ICIE1 );   // Enable interrupts
+}
+
+static inline void hal_gdo2_int_disable(void) {
+  TIMSK1 &= ~( 1<<ICIE1 );
+}
+
+static inline void hal_gdo2_int_ack(void) {
+  TIFR1 = ( 1<<ICF1 );
+}
+
+#else
+/***************************************************************
+** External interrupt
+** The ISR reads the RX clock and the pin level
+*/
+#define HAL_GDO2_EDGE_TIME()   HAL_RX_CLOCK()
+#define HAL_GDO2_EDGE_LEVEL()  HAL_GDO2_LEVEL()
+
+static inline void hal_gdo2_edge_next(void) {
+}
+
+static inline void hal_gdo2_int_enable(void) {
+  // rising and falling edge
+  EICRA &= ~( 1 << GDO2_INT_ISCn0 ) & ~( 1 << GDO2_INT_ISCn1 ) ;
+  EICRA |=  ( 1 << GDO2_INT_ISCn0 );
+
+  EIFR   = GDO2_INT_MASK ;    // Acknowledge any previous edges
+  EIMSK |= GDO2_INT_MASK ;    // Enable interrupts
+}
+
+static inline void hal_gdo2_int_disable(void) {
+  EIMSK &= ~GDO2_INT_MASK;
+}
+
+static inline void hal_gdo2_int_ack(void) {
+  EIFR |= GDO2_INT_MASK;
+}
+
+#endif
+
+/***************************************************************
+** GDO0 - TX data to radio
+*/
+#define HAL_GDO0_OUT(_bit) do{ if(_bit) GDO0_PORT |= GDO0_IN; else GDO0_PORT &= ~GDO0_IN; }while(0)
+
+#if defined(UART_TX_FIFO)
+/***************************************************************
+** GDO0 - TX FIFO below threshold from radio
+*/
+#define HAL_GDO0_LEVEL()  ( GDO0_PIN & GDO0_IN )
+
+static inline void hal_gdo0_int_enable(void) {
+  // rising edge
+  EICRA |= ( 1 << GDO0_INT_ISCn0 ) | ( 1 << GDO0_INT_ISCn1 );
+
+  EIFR   = GDO0_INT_MASK ;    // Acknowledge any previous edges
+  EIMSK |= GDO0_INT_MASK ;    // Enable interrupts
+}
+
+static inline void hal_gdo0_int_disable(void) {
+  EIMSK &= ~GDO0_INT_MASK;
+}
+#endif
+
+static inline void hal_gdo_init(void) {
+#if defined(UART_TX_FIFO)
+  GDO0_DDR  &= ~GDO0_IN;    // Input, driven by the radio
+  GDO0_PORT &= ~GDO0_IN;
+#else
+  GDO0_DDR  |=  GDO0_IN;
+  GDO0_PORT &= ~GDO0_IN;    // Start in SPACE
+#endif
+
+  GDO2_DDR  &= ~GDO2_IN;
+  GDO2_PORT |=  GDO2_IN;    // Set input pull-up
+}
+
+/***************************************************************
+** Software interrupt
+** Toggling the (output) pin raises a pin change interrupt
+*/
+#define HAL_SW_INT_TRIGGER() do{ SW_INT_PIN |= SW_INT_IN; }while(0)
+
+static inline void hal_sw_int_init(void) {
+  SW_INT_DDR  |= SW_INT_IN;
+  SW_INT_MASK |= SW_INT_IN;
+
+  PCIFR  = SW_INT_ENBL;  // Acknowledge any previous event
+  PCICR |= SW_INT_ENBL;  // and enable
+}
+
+/***************************************************************
+** TX bit clock
+** Timer0 CTC, pre-scaled by 8
+*/
+static inline void hal_tx_clock_init(void) {
+  TCCR0A = ( 1<<WGM01 ); // CTC, no output pins
+  TCCR0B = 0 ;
+
+  TCCR0B |= ( 1<<CS01 ); // Pre-scale by 8
+
+  OCR0A = 51;  // 38400 baud
+}
+
+static inline void hal_tx_clock_start(void) {
+  TCNT0 = 0;
+  TIMSK0 |= ( 1<<OCIE0A );
+}
+
+static inline void hal_tx_clock_stop(void) {
+  TIMSK0 &= ~( 1<<OCIE0A );
+}
+
+/***************************************************************
+** Host tty USART
+*/
+#define HAL_TTY_TX_READY()  ( UCSR0A & ( 1<<UDRE0 ) )
+#define HAL_TTY_TX(_byte)   do{ UDR0 = (_byte); }while(0)
+#define HAL_TTY_RX_READY()  ( UCSR0A & ( 1<<RXC0 ) )
+#define HAL_TTY_RX()        UDR0
+
+extern void hal_tty_init( uint32_t Fosc, uint32_t bitrate );
+
+static inline void hal_tty_tx_enable(void) {
+  UCSR0B &= ~( 1<<UDRIE0 );
+  UCSR0B |=  ( 1<<TXEN0 );
+}
+
+static inline void hal_tty_tx_disable(void) {
+  UCSR0B &= ~( 1<<TXEN0 );
+  UCSR0B &= ~( 1<<UDRIE0 );
+}
+
+// UDRE is level triggered, the ISR must disable it when it has nothing to send
+static inline void hal_tty_udre_int_enable(void) {
+  UCSR0B |= ( 1<<UDRIE0 );
+}
+
+static inline void hal_tty_udre_int_disable(void) {
+  UCSR0B &= ~( 1<<UDRIE0 );
+}
+
+static inline void hal_tty_rx_enable(void) {
+  // Enable the interrupt while disabled - RX buffer will be empty
+  UCSR0B |= ( 1<<RXCIE0 );
+
+  // Then enable RX
+  UCSR0B |= ( 1<<RXEN0 );
+}
+
+static inline void hal_tty_rx_disable(void) {
+  UCSR0B &= ~( 1<<RXEN0 );
+  UCSR0B &= ~( 1<<RXCIE0 );
+}
+
+#endif // _HAL_AVR_H_
@@ -0,0 +1,15 @@
+/**********************************************************
+** host/avr/boot.h
+**
+** Stand-in for avr-libc in the host build
+*/
+#ifndef _HOST_AVR_BOOT_H_
+#define _HOST_AVR_BOOT_H_
+
+#include <stdint.h>
+
+// Serial number bytes of the simulated device
+extern uint8_t host_signature_byte( uint8_t addr );
+#define boot_signature_byte_get(_addr) host_signature_byte(_addr)
+
+#endif
@@ -0,0 +1,22 @@
+/**********************************************************
+** host/avr/interrupt.h
+**
+** Stand-in for avr-libc in the host build
+**
+** SREG only carries the global interrupt flag. The host
+** simulation only dispatches ISRs while it is set.
+*/
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#include <stdint.h>
+
+#define SREG_I 0x80
+extern volatile uint8_t SREG;
+
+#define cli() do{ SREG &= ~SREG_I; }while(0)
+#define sei() do{ SREG |=  SREG_I; }while(0)
+
+#define ISR(_vector) void _vector(void)
+
+#endif
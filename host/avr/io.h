@@ -0,0 +1,12 @@
+/**********************************************************
+** host/avr/io.h
+**
+** Stand-in for avr-libc in the host build
+** Peripherals are reached through hal.h, not registers
+*/
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#endif
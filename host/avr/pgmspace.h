@@ -0,0 +1,24 @@
+/**********************************************************
+** host/avr/pgmspace.h
+**
+** Stand-in for avr-libc in the host build
+** There is only one address space so PROGMEM is plain const data
+*/
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(_s)  (_s)
+#define PGM_P     const char *
+
+#define pgm_read_byte(_p)  ( *(const uint8_t *)(_p) )
+#define pgm_read_word(_p)  ( *(_p) )
+#define pgm_read_dword(_p) ( *(_p) )
+
+#define memcpy_P  memcpy
+#define strlen_P  strlen
+
+#endif
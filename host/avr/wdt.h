@@ -0,0 +1,11 @@
+/**********************************************************
+** host/avr/wdt.h
+**
+** Stand-in for avr-libc in the host build
+*/
+#ifndef _HOST_AVR_WDT_H_
+#define _HOST_AVR_WDT_H_
+
+#define wdt_disable() do{}while(0)
+
+#endif
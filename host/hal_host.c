@@ -0,0 +1,784 @@
+/***************************************************************
+** hal_host.c
+**
+** Linux host backend of the hardware abstraction layer
+**
+** Runs the firmware with simulated time so the RX/TX pipeline can
+** be exercised and timed without a board or a radio.
+**
+**  -e <file>  Replay GDO2 edges, one "<time us> <level>" per line
+**  -c <ppm>   Clock error of the transmitter that sent the edges
+**  -w <file>  Capture GDO0 edges in the same format
+**  -i <file>  Virtual tty input ("-" for stdin)
+**  -o <file>  Virtual tty output (default stdout)
+**  -l <us>    Simulated duration of one main_work() pass (default 10)
+**  -t <ms>    Stop after this much simulated time
+**  -d <id>    Device ID returned from the signature row
+**
+** Statistics are reported on stderr when the inputs are exhausted.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <avr/interrupt.h>
+
+#include "hal.h"
+
+volatile uint8_t SREG;
+
+#define CYCLES_PER_US     ( F_CPU / 1000000 )
+#define RX_CLOCK_PRESCALE 8
+#define RX_CLOCK_OVF      ( 65536ULL * RX_CLOCK_PRESCALE )
+#define TX_CLOCK_PERIOD   ( 8 * ( 51+1 ) )                    // Timer0 CTC, pre-scale 8, OCR0A=51
+#define TTY_BYTE_CYCLES   ( ( F_CPU * 10 ) / TTY_BAUD_RATE )   // 8N1
+#define TTY_BURST_GAP     ( 4 * TTY_BYTE_CYCLES )              // Longer idle ends an output burst
+#define DRAIN_CYCLES      ( 100000ULL * CYCLES_PER_US )        // Idle time before we stop
+#define ICP_DELAY         4                                    // Input capture noise canceller
+#define RX_BIT_CYCLES     ( (double)F_CPU / 38400 )            // CC1101 demodulator bit period
+
+#define XOFF ( 'S' & 0x3F )
+#define XON  ( 'Q' & 0x3F )
+
+/***************************************************************
+** Simulated interrupt vectors
+*/
+enum host_isrs {
+  ISR_GDO0,
+  ISR_GDO2,
+  ISR_SW,
+  ISR_RX_CLOCK_OVF,
+  ISR_TX_CLOCK,
+  ISR_TTY_RX,
+  ISR_TTY_UDRE,
+  ISR_MAX
+};
+
+// Vectors a build doesn't use, like __bad_interrupt on the AVR
+#define HOST_WEAK_VECTOR(_v) void __attribute__((weak)) _v(void) {}
+HOST_WEAK_VECTOR( GDO0_INT_VECT )
+HOST_WEAK_VECTOR( GDO2_INT_VECT )
+HOST_WEAK_VECTOR( SW_INT_VECT )
+HOST_WEAK_VECTOR( RX_CLOCK_OVF_VECT )
+HOST_WEAK_VECTOR( TX_CLOCK_VECT )
+HOST_WEAK_VECTOR( TTY_RX_VECT )
+HOST_WEAK_VECTOR( TTY_UDRE_VECT )
+
+static void (* const host_vector[ISR_MAX])(void) = {
+  GDO0_INT_VECT, GDO2_INT_VECT, SW_INT_VECT, RX_CLOCK_OVF_VECT, TX_CLOCK_VECT, TTY_RX_VECT, TTY_UDRE_VECT
+};
+
+static char const * const host_vector_name[ISR_MAX] = {
+  "GDO0", "GDO2", "SW", "RX_CLOCK_OVF", "TX_CLOCK", "TTY_RX", "TTY_UDRE"
+};
+
+// Rough AVR cycles for each ISR, including entry and exit.
+// The SW ISR re-enables interrupts so it never delays the others.
+static uint8_t const host_vector_cycles[ISR_MAX] = {
+  0, 90, 0, 40, 80, 60, 50
+};
+
+struct host_edge {
+  uint64_t time;
+  uint8_t  level;
+};
+
+static struct host_state {
+  uint64_t now;
+  uint64_t loop;
+  uint64_t limit;
+  uint64_t lastActivity;
+  uint32_t id;
+
+  // GDO2 replay
+  struct host_edge *edges;
+  uint32_t nEdges;
+  uint32_t edge;
+  uint8_t gdo2;       // Demodulated data
+  uint8_t gdo2Line;   // GDO2 pin
+  uint8_t gdo2Int;
+  uint8_t gdo2Flag;
+  uint64_t gdo2Time;
+  double  clock;
+  double  rxBitNext;
+
+  // GDO0 capture
+  FILE *capture;
+  uint8_t gdo0;
+  uint8_t air;
+  uint8_t gdo0Line;
+  uint8_t gdo0Int;
+  double  txBitNext;
+
+  // Timers and software interrupt
+  uint8_t  rxOvfInt;
+  uint64_t rxOvfNext;
+  uint8_t  txClock;
+  uint64_t txNext;
+  uint8_t  swInt;
+  uint8_t  swPending;
+  uint8_t  isrPending;
+
+  // Virtual tty
+  uint8_t *ttyIn;
+  uint32_t nTtyIn;
+  uint32_t ttyInPos;
+  uint64_t ttyRxNext;
+  uint8_t  ttyRxEnable;
+  uint8_t  ttyRxReady;
+  uint8_t  ttyRxData;
+  uint8_t  xoff;
+  uint64_t xoffStart;
+
+  FILE *ttyOut;
+  uint8_t  ttyTxEnable;
+  uint8_t  ttyUdreInt;
+  uint64_t ttyTxBusy;
+  uint8_t  lineStart;
+  uint8_t  inMsg;
+
+  // Statistics
+  uint32_t nEdgeIsr;
+  uint32_t nEdgeTime;
+  uint64_t edgeDelay;
+  uint64_t edgeDelayMax;
+  double   edgeDelaySq;
+  uint32_t nMsgs;
+  uint64_t lineBegin;
+  int64_t  lineStartDelay;
+  int64_t  lineEndDelay;
+  uint64_t ttyTxBytes;
+  uint64_t ttyTxLast;
+  uint64_t ttyBurstBusy;
+  uint64_t ttyBurstIdle;
+  uint32_t nXoff;
+  uint64_t xoffCycles;
+  uint64_t isrNs;
+  uint8_t  isr;
+  uint32_t isrCount[ISR_MAX];
+  uint64_t isrVecNs[ISR_MAX];
+  uint64_t mainNs;
+  uint64_t mainStart;
+  uint64_t mainIsrNs;
+  uint64_t cpuOverhead;
+} host;
+
+/***************************************************************
+** CPU time accounting
+*/
+static uint64_t host_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Cost of reading the clock, taken off every measurement
+static uint64_t host_cpu_overhead(void) {
+  uint64_t best = ~0ULL;
+  uint16_t i;
+
+  for( i=0 ; i<1000 ; i++ ) {
+    uint64_t t0 = host_cpu_ns();
+    uint64_t ns = host_cpu_ns() - t0;
+    if( ns < best ) best = ns;
+  }
+
+  return best;
+}
+
+static void host_vector_call( uint8_t isr ) {
+  uint64_t t0 = host_cpu_ns(), ns;
+  uint8_t outer = host.isr;
+
+  host.isr = isr;
+  SREG &= ~SREG_I;
+  host_vector[isr]();
+  SREG |= SREG_I;
+  host.isr = outer;
+
+  ns = host_cpu_ns() - t0;
+  ns = ( ns > host.cpuOverhead ) ? ns - host.cpuOverhead : 0;
+  host.isrCount[isr]++;
+  host.isrVecNs[isr] += ns;
+  host.isrNs += ns;
+}
+
+static void host_isr( uint8_t isr ) {
+  // Held, like the AVR's interrupt flags, until interrupts are enabled
+  if( !( SREG & SREG_I ) ) {
+    host.isrPending |= ( 1<<isr );
+    return;
+  }
+
+  host_vector_call( isr );
+  host.now += host_vector_cycles[isr];
+
+  // The software interrupt is raised from inside other ISRs
+  while( host.swPending && host.swInt ) {
+    host.swPending = 0;
+    host_vector_call( ISR_SW );
+  }
+}
+
+// Lowest vector first, as on the AVR
+static void host_isr_pending(void) {
+  uint8_t isr;
+
+  for( isr=0 ; isr<ISR_MAX && host.isrPending ; isr++ ) {
+    if( host.isrPending & ( 1<<isr ) ) {
+      host.isrPending &= ~( 1<<isr );
+      host_isr( isr );
+    }
+  }
+}
+
+/***************************************************************
+** Event scheduler
+*/
+enum host_events {
+  EV_NONE,
+  EV_EDGE,
+  EV_RX_OVF,
+  EV_TX_CLOCK,
+  EV_TTY_RX,
+  EV_TTY_UDRE,
+  EV_RX_BIT,
+  EV_TX_BIT,
+  EV_CC,
+};
+
+// Signal sent by the radio
+static void host_air_tx( uint8_t bit, uint64_t time ) {
+  if( bit != host.air ) {
+    host.air = bit;
+    if( host.capture )
+      fprintf( host.capture, "%.3f %u\n", (double)time / CYCLES_PER_US, bit );
+  }
+}
+
+// Nothing gets on air unless the radio is in TX
+void host_air_update(void) {
+  if( host_cc_tx_async() )
+    host_air_tx( host.gdo0, host.now );
+  else if( !host_cc_tx_sending() )
+    host_air_tx( 0, host.now );
+}
+
+// Signal being received, the edges come at least every 10 bits
+uint8_t host_air_carrier(void) {
+  return host.edge > 0 && host.edge < host.nEdges
+      && host.now < host.gdo2Time + 12 * RX_BIT_CYCLES;
+}
+
+static void host_gdo0_update(void) {
+  uint8_t line = host_cc_gdo0();
+
+  if( line != host.gdo0Line ) {
+    host.gdo0Line = line;
+    if( line && host.gdo0Int )  // Rising edge
+      host_isr( ISR_GDO0 );
+  }
+}
+
+// The GDO2 ISR is raised by changes of the pin, which
+// isn't necessarily the data (see host_cc_gdo2)
+static void host_gdo2_update(void) {
+  uint8_t line = host_cc_gdo2( host.gdo2 );
+
+  if( line != host.gdo2Line ) {
+    host.gdo2Line = line;
+    if( host.gdo2Int ) {
+      host.nEdgeIsr++;
+      host_isr( ISR_GDO2 );
+    } else {
+      host.gdo2Flag = 1;
+    }
+  }
+}
+
+// The radio and the tty keep going while interrupts are disabled,
+// any ISRs they raise are held until they are enabled again.
+static void host_run_until( uint64_t until ) {
+  for(;;) {
+    uint64_t next = until;
+    uint8_t event = EV_NONE;
+
+    if( SREG & SREG_I )
+      host_isr_pending();
+
+    if( host.edge < host.nEdges && host.edges[host.edge].time < next ) {
+      next = host.edges[host.edge].time;
+      event = EV_EDGE;
+    }
+    if( host.rxOvfInt && host.rxOvfNext < next ) {
+      next = host.rxOvfNext;
+      event = EV_RX_OVF;
+    }
+    if( host.txClock && host.txNext < next ) {
+      next = host.txNext;
+      event = EV_TX_CLOCK;
+    }
+    if( host.ttyRxEnable && !host.xoff && !host.ttyRxReady
+     && host.ttyInPos < host.nTtyIn && host.ttyRxNext < next ) {
+      next = host.ttyRxNext;
+      event = EV_TTY_RX;
+    }
+    // UDRE is a level, raised once until the ISR has run
+    if( host.ttyTxEnable && host.ttyUdreInt && !( host.isrPending & ( 1<<ISR_TTY_UDRE ) )
+     && host.ttyTxBusy < next ) {
+      next = host.ttyTxBusy;
+      event = EV_TTY_UDRE;
+    }
+    if( host_cc_rx_sampling() ) {
+      if( host.rxBitNext + RX_BIT_CYCLES < host.now )  // Just entered RX
+        host.rxBitNext = host.now;
+      if( (uint64_t)host.rxBitNext < next ) {
+        next = (uint64_t)host.rxBitNext;
+        event = EV_RX_BIT;
+      }
+    }
+    if( host_cc_tx_sending() ) {
+      if( host.txBitNext + RX_BIT_CYCLES < host.now )  // Just entered TX
+        host.txBitNext = host.now;
+      if( (uint64_t)host.txBitNext < next ) {
+        next = (uint64_t)host.txBitNext;
+        event = EV_TX_BIT;
+      }
+    }
+    if( host_cc_due() && host_cc_due() < next ) {
+      next = host_cc_due();
+      event = EV_CC;
+    }
+
+    if( next > host.now ) host.now = next;
+    if( event==EV_NONE )
+      break;
+
+    switch( event ) {
+    case EV_EDGE:
+      host.gdo2Time = host.edges[host.edge].time;
+      host.gdo2 = host.edges[host.edge++].level;
+      host.lastActivity = host.now;
+      host.rxBitNext = host.gdo2Time + RX_BIT_CYCLES/2;  // Bit clock locks to the edges
+      host_gdo2_update();
+      break;
+
+    case EV_RX_BIT:
+      host.rxBitNext += RX_BIT_CYCLES;
+      host_cc_rx_bit( host.gdo2 );
+      host_gdo2_update();
+      break;
+
+    case EV_TX_BIT:
+      // On the radio's bit clock, even if an ISR held up the simulation
+      host_air_tx( host_cc_tx_bit(), (uint64_t)host.txBitNext );
+      host.txBitNext += RX_BIT_CYCLES;
+      host.lastActivity = host.now;
+      host_gdo0_update();
+      break;
+
+    case EV_CC:
+      host_cc_update();
+      host_air_update();
+      host_gdo0_update();
+      host_gdo2_update();
+      break;
+
+    case EV_RX_OVF:
+      host.rxOvfNext += RX_CLOCK_OVF;
+      host_isr( ISR_RX_CLOCK_OVF );
+      break;
+
+    case EV_TX_CLOCK:
+      host.txNext += TX_CLOCK_PERIOD;
+      host.lastActivity = host.now;
+      host_isr( ISR_TX_CLOCK );
+      break;
+
+    case EV_TTY_RX:
+      host.ttyRxData = host.ttyIn[host.ttyInPos++];
+      host.ttyRxReady = 1;
+      host.ttyRxNext = host.now + TTY_BYTE_CYCLES;
+      host.lastActivity = host.now;
+      host_isr( ISR_TTY_RX );
+      break;
+
+    case EV_TTY_UDRE:
+      host_isr( ISR_TTY_UDRE );
+      break;
+    }
+  }
+}
+
+uint64_t host_now(void) {
+  return host.now;
+}
+
+void host_delay_us( double us ) {
+  host_run_until( host.now + (uint64_t)( us * CYCLES_PER_US ) );
+}
+
+uint8_t host_signature_byte( uint8_t addr ) {
+  // Serial number is in bytes 0x15..0x17, most significant first
+  return (uint8_t)( host.id >> ( 8 * ( 0x17 - addr ) ) );
+}
+
+/***************************************************************
+** RX edge clock
+*/
+uint16_t hal_rx_clock(void) {
+  return (uint16_t)( host.now / RX_CLOCK_PRESCALE );
+}
+
+void hal_rx_clock_init(void) {
+  host.rxOvfInt = 1;
+  host.rxOvfNext = ( host.now / RX_CLOCK_OVF + 1 ) * RX_CLOCK_OVF;
+}
+
+void hal_rx_clock_run(void) {
+}
+
+/***************************************************************
+** ISR profiling clock
+*/
+uint16_t hal_prof_clock( uint8_t exit ) {
+  uint64_t time = host.now;
+
+  if( exit )
+    time += host_vector_cycles[host.isr];
+
+  return (uint16_t)( time / RX_CLOCK_PRESCALE );
+}
+
+void hal_prof_clock_init(void) {
+}
+
+/***************************************************************
+** GDO2 - RX data from radio
+*/
+uint8_t hal_gdo2_level(void) {
+  return host_cc_gdo2( host.gdo2 );
+}
+
+// Timestamp of the latest edge, with its delay from the real edge
+uint16_t hal_gdo2_edge_time(void) {
+#if defined(GDO2_ICP1)
+  uint64_t time = host.gdo2Time + ICP_DELAY;
+#else
+  uint64_t time = host.now;
+#endif
+  uint64_t delay = time - host.gdo2Time;
+
+  host.nEdgeTime++;
+  host.edgeDelay += delay;
+  host.edgeDelaySq += (double)delay * delay;
+  if( delay > host.edgeDelayMax ) host.edgeDelayMax = delay;
+
+  return (uint16_t)( time / RX_CLOCK_PRESCALE );
+}
+
+void hal_gdo2_edge_next(void) {
+}
+
+void hal_gdo2_int_enable(void) {
+  host.gdo2Line = hal_gdo2_level();
+  host.gdo2Flag = 0;
+  host.gdo2Int = 1;
+}
+
+void hal_gdo2_int_disable(void) {
+  host.gdo2Int = 0;
+}
+
+void hal_gdo2_int_ack(void) {
+  host.gdo2Flag = 0;
+}
+
+/***************************************************************
+** GDO0 - TX data to radio
+*/
+void hal_gdo0_out( uint8_t bit ) {
+  host.gdo0 = ( bit ) ? 1 : 0;
+  host_air_update();
+}
+
+uint8_t hal_gdo0_level(void) {
+  return host_cc_gdo0();
+}
+
+void hal_gdo0_int_enable(void) {
+  host.gdo0Line = hal_gdo0_level();
+  host.gdo0Int = 1;
+}
+
+void hal_gdo0_int_disable(void) {
+  host.gdo0Int = 0;
+}
+
+void hal_gdo_init(void) {
+  host.gdo0 = 0;
+  host.gdo2 = 0;
+}
+
+/***************************************************************
+** Software interrupt
+*/
+void hal_sw_int_trigger(void) {
+  host.swPending = 1;
+}
+
+void hal_sw_int_init(void) {
+  host.swPending = 0;
+  host.swInt = 1;
+}
+
+/***************************************************************
+** TX bit clock
+*/
+void hal_tx_clock_init(void) {
+  host.txClock = 0;
+}
+
+void hal_tx_clock_start(void) {
+  host.txClock = 1;
+  host.txNext = host.now + TX_CLOCK_PERIOD;
+}
+
+void hal_tx_clock_stop(void) {
+  host.txClock = 0;
+}
+
+/***************************************************************
+** Virtual tty
+*/
+uint8_t hal_tty_tx_ready(void) {
+  return host.ttyTxEnable && host.now >= host.ttyTxBusy;
+}
+
+void hal_tty_tx( uint8_t byte ) {
+  // Idle time between bytes of an output burst
+  if( host.ttyTxBytes && host.now < host.ttyTxLast + TTY_BURST_GAP ) {
+    host.ttyBurstBusy += TTY_BYTE_CYCLES;
+    host.ttyBurstIdle += host.now - host.ttyTxLast - TTY_BYTE_CYCLES;
+  }
+  host.ttyTxLast = host.now;
+
+  host.ttyTxBusy = host.now + TTY_BYTE_CYCLES;
+  host.ttyTxBytes++;
+  host.lastActivity = host.now;
+
+  if( byte==XOFF || byte==XON ) {
+    // Time the host is held off by flow control
+    if( byte==XOFF && !host.xoff ) {
+      host.nXoff++;
+      host.xoffStart = host.now;
+    } else if( byte==XON && host.xoff ) {
+      host.xoffCycles += host.now - host.xoffStart;
+    }
+    host.xoff = ( byte==XOFF );
+    return;
+  }
+
+  // Every line that isn't a comment is a message
+  if( host.lineStart && byte!='#' && byte!='\r' && byte!='\n' ) {
+    host.nMsgs++;
+    host.inMsg = 1;
+    host.lineBegin = host.now;
+  }
+
+  // Line timing relative to the last edge of the frame it reports
+  if( byte=='\n' && host.inMsg ) {
+    host.inMsg = 0;
+    host.lineStartDelay += (int64_t)( host.lineBegin - host.gdo2Time );
+    host.lineEndDelay += (int64_t)( host.now - host.gdo2Time );
+  }
+  host.lineStart = ( byte=='\n' );
+
+  fputc( byte, host.ttyOut );
+}
+
+uint8_t hal_tty_rx_ready(void) {
+  return host.ttyRxReady;
+}
+
+uint8_t hal_tty_rx(void) {
+  host.ttyRxReady = 0;
+  return host.ttyRxData;
+}
+
+void hal_tty_init( uint32_t Fosc __attribute__((unused)), uint32_t bitrate __attribute__((unused)) ) {
+  host.ttyRxEnable = 0;
+  host.ttyTxEnable = 0;
+}
+
+void hal_tty_tx_enable(void)  { host.ttyTxEnable = 1; host.ttyUdreInt = 0; }
+void hal_tty_tx_disable(void) { host.ttyTxEnable = 0; host.ttyUdreInt = 0; }
+void hal_tty_udre_int_enable(void)  { host.ttyUdreInt = 1; }
+void hal_tty_udre_int_disable(void) { host.ttyUdreInt = 0; }
+void hal_tty_rx_enable(void)  { host.ttyRxEnable = 1; }
+void hal_tty_rx_disable(void) { host.ttyRxEnable = 0; }
+
+/***************************************************************
+** Harness
+*/
+static uint8_t *host_read_file( const char *path, uint32_t *len ) {
+  FILE *fp = ( strcmp( path, "-" ) ) ? fopen( path, "rb" ) : stdin;
+  uint8_t *data = NULL;
+  uint32_t size = 0, n = 0;
+
+  if( !fp ) {
+    perror( path );
+    exit( 1 );
+  }
+
+  for(;;) {
+    if( n==size ) {
+      size = ( size ) ? size*2 : 4096;
+      data = realloc( data, size+1 );
+    }
+    uint32_t got = fread( data+n, 1, size-n, fp );
+    if( !got ) break;
+    n += got;
+  }
+  data[n] = '\0';
+
+  if( fp != stdin ) fclose( fp );
+
+  *len = n;
+  return data;
+}
+
+static void host_load_edges( const char *path ) {
+  uint32_t len, size = 0;
+  char *text = (char *)host_read_file( path, &len );
+  char *line = strtok( text, "\n" );
+
+  while( line ) {
+    double us;
+    unsigned int level;
+
+    if( line[0]!='#' && 2==sscanf( line, "%lf %u", &us, &level ) ) {
+      if( host.nEdges==size ) {
+        size = ( size ) ? size*2 : 1024;
+        host.edges = realloc( host.edges, size * sizeof(*host.edges) );
+      }
+      host.edges[host.nEdges].time  = (uint64_t)( us * host.clock * CYCLES_PER_US );
+      host.edges[host.nEdges].level = ( level ) ? 1 : 0;
+      host.nEdges++;
+    }
+    line = strtok( NULL, "\n" );
+  }
+
+  free( text );
+}
+
+static void host_usage( const char *prog ) {
+  fprintf( stderr, "usage: %s [-c ppm] [-e edges] [-w capture] [-i tty_in] [-o tty_out] [-l loop_us] [-t limit_ms] [-d id]\n", prog );
+  exit( 1 );
+}
+
+void host_init( int argc, char *argv[] ) {
+  const char *edgeFile = NULL;
+  int opt;
+
+  memset( &host, 0, sizeof(host) );
+  host.loop = 10 * CYCLES_PER_US;
+  host.id = 0x4DADA;
+  host.ttyOut = stdout;
+  host.lineStart = 1;
+  host.clock = 1.0;
+  host.cpuOverhead = host_cpu_overhead();
+
+  while( ( opt = getopt( argc, argv, "e:c:w:i:o:l:t:d:" ) ) != -1 ) {
+    switch( opt ) {
+    case 'e': edgeFile = optarg;                                             break;
+    case 'c': host.clock = 1.0 + atof( optarg ) / 1e6;                       break;
+    case 'w': host.capture = fopen( optarg, "w" );                           break;
+    case 'i': host.ttyIn = host_read_file( optarg, &host.nTtyIn );           break;
+    case 'o': host.ttyOut = fopen( optarg, "w" );                            break;
+    case 'l': host.loop = (uint64_t)( atof( optarg ) * CYCLES_PER_US );      break;
+    case 't': host.limit = (uint64_t)( atof( optarg ) * 1000 * CYCLES_PER_US ); break;
+    case 'd': host.id = strtoul( optarg, NULL, 0 );                          break;
+    default:  host_usage( argv[0] );
+    }
+  }
+
+  if( !host.ttyOut )
+    host_usage( argv[0] );
+  if( edgeFile )
+    host_load_edges( edgeFile );
+  if( host.loop==0 )
+    host.loop = 1;
+}
+
+uint8_t host_work(void) {
+  // Time spent in main_work() since the last pass, less any ISRs it ran
+  if( host.mainStart )
+    host.mainNs += ( host_cpu_ns() - host.mainStart ) - ( host.isrNs - host.mainIsrNs );
+
+  host_run_until( host.now + host.loop );
+
+  if( host.limit ) {
+    if( host.now >= host.limit )
+      return 0;
+  } else if( host.edge==host.nEdges && host.ttyInPos==host.nTtyIn && !host.txClock && !host_cc_tx_sending() && !host_cc_due() ) {
+    if( host.now > host.lastActivity + DRAIN_CYCLES )
+      return 0;
+  }
+
+  host.mainIsrNs = host.isrNs;
+  host.mainStart = host_cpu_ns();
+  return 1;
+}
+
+void host_report(void) {
+  double simMs = (double)host.now / ( 1000.0 * CYCLES_PER_US );
+  double linkMs = (double)host.ttyTxBytes * TTY_BYTE_CYCLES / ( 1000.0 * CYCLES_PER_US );
+  double cpuUs = (double)( host.isrNs + host.mainNs ) / 1000.0;
+  uint8_t i;
+
+  if( host.capture ) fclose( host.capture );
+  fflush( host.ttyOut );
+
+  fprintf( stderr, "# host: simulated %.3f ms\n", simMs );
+  fprintf( stderr, "# host: %u GDO2 edges (%u ISR), %u messages, %llu tty bytes (%.1f%% of link)\n",
+           host.nEdges, host.nEdgeIsr, host.nMsgs,
+           (unsigned long long)host.ttyTxBytes, ( simMs > 0 ) ? 100.0 * linkMs / simMs : 0.0 );
+  if( host.nXoff )
+    fprintf( stderr, "# host: tty input held off %u times for %.3f ms\n",
+             host.nXoff, (double)host.xoffCycles / ( 1000.0 * CYCLES_PER_US ) );
+  if( host.ttyBurstBusy )
+    fprintf( stderr, "# host: tty busy %.1f%% of output bursts\n",
+             100.0 * host.ttyBurstBusy / ( host.ttyBurstBusy + host.ttyBurstIdle ) );
+  if( host.nEdgeTime ) {
+    double mean = (double)host.edgeDelay / host.nEdgeTime;
+    double var  = host.edgeDelaySq / host.nEdgeTime - mean*mean;
+    fprintf( stderr, "# host: GDO2 %s timestamps delay %.3f us, jitter %.3f us (sd), max %.3f us\n",
+#if defined(GDO2_ICP1)
+             "capture",
+#else
+             "ISR",
+#endif
+             mean / CYCLES_PER_US, sqrt( ( var > 0 ) ? var : 0 ) / CYCLES_PER_US,
+             (double)host.edgeDelayMax / CYCLES_PER_US );
+  }
+  fprintf( stderr, "# host: CPU isr %.3f ms, main %.3f ms\n",
+           host.isrNs / 1e6, host.mainNs / 1e6 );
+  for( i=0 ; i<ISR_MAX ; i++ ) {
+    if( host.isrCount[i] )
+      fprintf( stderr, "# host:   %-12s %8u calls %9.1f ns/call\n", host_vector_name[i],
+               host.isrCount[i], (double)host.isrVecNs[i] / host.isrCount[i] );
+  }
+  host_cc_report();
+  if( host.nMsgs )
+    fprintf( stderr, "# host: message lines start %+.2f ms, end %+.2f ms from the end of their frame\n",
+             (double)host.lineStartDelay / host.nMsgs / ( 1000.0 * CYCLES_PER_US ),
+             (double)host.lineEndDelay / host.nMsgs / ( 1000.0 * CYCLES_PER_US ) );
+  if( host.nMsgs )
+    fprintf( stderr, "# host: %.2f us isr + %.2f us main CPU/message, %.0f messages/s\n",
+             host.isrNs / 1e3 / host.nMsgs, host.mainNs / 1e3 / host.nMsgs,
+             host.nMsgs * 1e6 / cpuUs );
+}
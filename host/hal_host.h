@@ -0,0 +1,144 @@
+/***************************************************************
+** hal_host.h
+**
+** Linux host backend of the hardware abstraction layer
+** Include hal.h instead of this file
+**
+** Time is simulated in CPU clock cycles. Between main_work() passes
+** host_work() advances the clock and dispatches every ISR that
+** became due: GDO2 edges replayed from a file, timer events and
+** bytes on the virtual tty. An ISR keeps the CPU busy for roughly
+** as long as it would on the AVR, delaying any that become due.
+** ISRs raised while interrupts are disabled are held until they
+** are enabled again.
+*/
+#ifndef _HAL_H_
+#  error "Include hal.h instead of this file"
+#endif
+
+#ifndef _HAL_HOST_H_
+#define _HAL_HOST_H_
+
+#include <stdint.h>
+
+/***************************************************************
+** RX edge clock
+*/
+extern uint16_t hal_rx_clock(void);
+#define HAL_RX_CLOCK()  hal_rx_clock()
+
+extern void hal_rx_clock_init(void);
+extern void hal_rx_clock_run(void);
+
+/***************************************************************
+** ISR profiling clock
+** The busy time of the running ISR is charged by its exit
+*/
+extern uint16_t hal_prof_clock( uint8_t exit );
+#define HAL_PROF_CLOCK()       hal_prof_clock( 0 )
+#define HAL_PROF_CLOCK_EXIT()  hal_prof_clock( 1 )
+#define HAL_PROF_CYCLES        8
+
+extern void hal_prof_clock_init(void);
+
+/***************************************************************
+** GDO2 - RX data from radio
+*/
+extern uint8_t hal_gdo2_level(void);
+#define HAL_GDO2_LEVEL()  hal_gdo2_level()
+
+extern uint16_t hal_gdo2_edge_time(void);
+extern void hal_gdo2_edge_next(void);
+#define HAL_GDO2_EDGE_TIME()   hal_gdo2_edge_time()
+#define HAL_GDO2_EDGE_LEVEL()  hal_gdo2_level()
+
+extern void hal_gdo2_int_enable(void);
+extern void hal_gdo2_int_disable(void);
+extern void hal_gdo2_int_ack(void);
+
+/***************************************************************
+** GDO0 - TX data to radio
+*/
+extern void hal_gdo0_out( uint8_t bit );
+#define HAL_GDO0_OUT(_bit) hal_gdo0_out(_bit)
+
+extern uint8_t hal_gdo0_level(void);
+#define HAL_GDO0_LEVEL()  hal_gdo0_level()
+
+extern void hal_gdo0_int_enable(void);
+extern void hal_gdo0_int_disable(void);
+
+extern void hal_gdo_init(void);
+
+/***************************************************************
+** Software interrupt
+*/
+extern void hal_sw_int_trigger(void);
+#define HAL_SW_INT_TRIGGER() hal_sw_int_trigger()
+
+extern void hal_sw_int_init(void);
+
+/***************************************************************
+** TX bit clock
+*/
+extern void hal_tx_clock_init(void);
+extern void hal_tx_clock_start(void);
+extern void hal_tx_clock_stop(void);
+
+/***************************************************************
+** Host tty USART
+*/
+extern uint8_t hal_tty_tx_ready(void);
+extern void hal_tty_tx( uint8_t byte );
+extern uint8_t hal_tty_rx_ready(void);
+extern uint8_t hal_tty_rx(void);
+#define HAL_TTY_TX_READY()  hal_tty_tx_ready()
+#define HAL_TTY_TX(_byte)   hal_tty_tx(_byte)
+#define HAL_TTY_RX_READY()  hal_tty_rx_ready()
+#define HAL_TTY_RX()        hal_tty_rx()
+
+extern void hal_tty_init( uint32_t Fosc, uint32_t bitrate );
+extern void hal_tty_tx_enable(void);
+extern void hal_tty_tx_disable(void);
+extern void hal_tty_udre_int_enable(void);
+extern void hal_tty_udre_int_disable(void);
+extern void hal_tty_rx_enable(void);
+extern void hal_tty_rx_disable(void);
+
+/***************************************************************
+** Host simulation
+*/
+extern uint64_t host_now(void);
+
+extern void host_delay_us( double us );
+
+extern void host_init( int argc, char *argv[] );
+extern uint8_t host_work(void);
+extern void host_report(void);
+
+// Signal on air, for the CC1101 model
+extern uint8_t host_air_carrier(void);
+extern void host_air_update(void);
+
+// CC1101 model (spi_host.c)
+extern void host_cc_update(void);
+extern uint64_t host_cc_due(void);
+extern uint8_t host_cc_rx_sampling(void);
+extern void host_cc_rx_bit( uint8_t bit );
+extern uint8_t host_cc_gdo2( uint8_t data );
+extern uint8_t host_cc_gdo0(void);
+extern uint8_t host_cc_tx_async(void);
+extern uint8_t host_cc_tx_sending(void);
+extern uint8_t host_cc_tx_bit(void);
+extern void host_cc_report(void);
+
+// ISRs called by the simulation
+extern void GDO0_INT_VECT(void);
+extern void GDO2_INT_VECT(void);
+extern void SW_INT_VECT(void);
+extern void RX_CLOCK_OVF_VECT(void);
+extern void TX_CLOCK_VECT(void);
+extern void TTY_RX_VECT(void);
+extern void TTY_UDRE_VECT(void);
+
+#endif // _HAL_HOST_H_
@@ -0,0 +1,29 @@
+/**********************************************************
+** host_pins.h
+**
+** Abstract pin names and definitions for the Linux host build
+**
+** ISR vectors become plain functions that the host
+** simulation (hal_host.c) calls when their event is due
+*/
+
+#ifndef _CONFIG_H_
+#  error "Include config.h instead of this file"
+#endif
+
+#ifndef _HOST_PINS_H_
+#define _HOST_PINS_H_
+
+#ifndef F_CPU
+  #define F_CPU 16000000UL
+#endif
+
+#define GDO0_INT_VECT     host_gdo0_vect
+#define GDO2_INT_VECT     host_gdo2_vect
+#define SW_INT_VECT       host_sw_vect
+#define RX_CLOCK_OVF_VECT host_rx_clock_ovf_vect
+#define TX_CLOCK_VECT     host_tx_clock_vect
+#define TTY_RX_VECT       host_tty_rx_vect
+#define TTY_UDRE_VECT     host_tty_udre_vect
+
+#endif
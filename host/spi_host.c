@@ -0,0 +1,530 @@
+/***************************************************************
+** spi_host.c
+**
+** SPI backend for the host build
+**
+** A behavioural model of the CC1101 on the other end of the bus:
+** register file, command strobes, chip status byte, the RX and TX
+** FIFOs, RSSI and the GDO pins.
+**
+** Every SPI byte takes simulated time at SPI_CLK_RATE and the radio
+** takes time to change state: the frequency synthesizer calibrates
+** (MCSM0 FS_AUTOCAL) and settles on the way out of IDLE and RX/TX
+** turnarounds take a little longer than a bit. The status byte shows
+** CALIBRATE and SETTLING meanwhile, so the busy-waits in cc1101.c
+** cost what they would on the board. The time from leaving RX until
+** TX is reached, and back, is reported with the host statistics.
+**
+** In RX with PKTCTRL0 in normal (FIFO) mode the demodulated bits,
+** sampled by hal_host.c, are checked for the sync word and then
+** loaded into the RX FIFO. In TX the TX FIFO is sent a bit at a time
+** at hal_host.c's request until the packet length or an underflow.
+** In asynchronous serial mode hal_host.c passes GDO0 straight on air
+** while the radio is in TX.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include <util/delay.h>
+
+#include "config.h"
+#include "cc1101_const.h"
+
+#include "spi.h"
+#include "hal.h"
+
+#define CC_STATUS_REG 0x30
+#define CC_FIFO_SIZE  64
+
+// Radio timing, CC1101 datasheet section 19.6 (approximate)
+#define CC_RESET_US       41.0    // SRES until CHIP_RDYn
+#define CC_CAL_US        721.0    // Frequency synthesizer calibration
+#define CC_SETTLE_US      75.1    // IDLE to RX/TX/FSTXON, 1953/fXOSC
+#define CC_TURNAROUND_US  31.0    // Between RX, TX and FSTXON
+#define CC_SPI_BYTE_US    ( 8e6 / SPI_CLK_RATE )
+#define CC_MISO_POLL_US   0.25
+
+// RSSI register values, RSSI_dBm = RSSI/2 - 74
+#define CC_RSSI_NOISE     (uint8_t)( ( -100 + 74 ) * 2 )
+#define CC_RSSI_CARRIER   (uint8_t)( (  -50 + 74 ) * 2 )
+
+#define US_CYCLES(_us)    (uint64_t)( (_us) * ( F_CPU / 1000000 ) )
+
+struct spi_host_turnaround {
+  uint32_t n;
+  uint64_t total;
+  uint64_t max;
+};
+
+static struct spi_host {
+  uint8_t cs;
+  uint8_t header;
+  uint8_t count;
+
+  uint8_t  state;
+  uint8_t  target;    // State at the end of a transition
+  uint64_t due;       // End of CALIBRATE/SETTLING, 0 when settled
+  uint64_t ready;     // CHIP_RDYn goes low
+  uint8_t  regs[0x40];
+  uint8_t  status[0x10];
+
+  // RX FIFO
+  uint8_t  rxFifo[CC_FIFO_SIZE];
+  uint8_t  rxHead;
+  uint8_t  rxCount;
+  uint16_t syncShift;
+  uint8_t  synced;
+  uint8_t  rxByte;
+  uint8_t  rxBits;
+
+  // TX FIFO
+  uint8_t  txFifo[CC_FIFO_SIZE];
+  uint8_t  txHead;
+  uint8_t  txCount;
+  uint8_t  txByte;
+  uint8_t  txBits;
+  uint8_t  txSent;
+
+  // Statistics
+  uint8_t  leftState;
+  uint64_t leftTime;
+  uint32_t nCal;
+  uint32_t nTxBusy;
+  struct spi_host_turnaround rxToTx;
+  struct spi_host_turnaround txToRx;
+} spi;
+
+static void spi_host_rx_flush(void) {
+  spi.rxHead  = 0;
+  spi.rxCount = 0;
+}
+
+static void spi_host_tx_flush(void) {
+  spi.txHead  = 0;
+  spi.txCount = 0;
+}
+
+/***************************************************************
+** Radio state
+*/
+static void spi_host_turnaround( struct spi_host_turnaround *t ) {
+  uint64_t time = host_now() - spi.leftTime;
+
+  t->n++;
+  t->total += time;
+  if( time > t->max ) t->max = time;
+}
+
+static void spi_host_set_state( uint8_t state ) {
+  if( state==spi.state )
+    return;
+
+  // Turnaround is timed from the moment RX or TX is left
+  if( spi.state==CC_STATE_RX || spi.state==CC_STATE_TX ) {
+    spi.leftState = spi.state;
+    spi.leftTime = host_now();
+  }
+
+  if( state==CC_STATE_RX ) {
+    if( spi.leftState==CC_STATE_TX ) spi_host_turnaround( &spi.txToRx );
+    spi.leftState = 0;
+    spi.synced = 0;
+    spi.syncShift = 0;
+  } else if( state==CC_STATE_TX ) {
+    if( spi.leftState==CC_STATE_RX ) spi_host_turnaround( &spi.rxToTx );
+    spi.leftState = 0;
+    spi.txBits = 0;
+    spi.txSent = 0;
+    if( host_air_carrier() ) spi.nTxBusy++;
+  } else if( state==CC_STATE_CALIBRATE ) {
+    spi.nCal++;
+  }
+
+  spi.state = state;
+  host_air_update();
+}
+
+// Transient state until the given time
+static void spi_host_transient( uint8_t state, double us, uint8_t target ) {
+  spi_host_set_state( state );
+  spi.target = target;
+  spi.due = host_now() + US_CYCLES( us );
+}
+
+void host_cc_update(void) {
+  while( spi.due && host_now() >= spi.due ) {
+    if( spi.state==CC_STATE_CALIBRATE && spi.target!=CC_STATE_IDLE ) {
+      spi_host_set_state( CC_STATE_SETTLING );
+      spi.due += US_CYCLES( CC_SETTLE_US );
+    } else {
+      spi.due = 0;
+      spi_host_set_state( spi.target );
+    }
+  }
+}
+
+uint64_t host_cc_due(void) {
+  return spi.due;
+}
+
+// SRX, STX and SFSTXON
+static void spi_host_go( uint8_t target ) {
+  if( spi.due ) {
+    // Already on the way, a later STX or SRX takes over
+    if( spi.target!=CC_STATE_IDLE && target!=CC_STATE_FSTXON )
+      spi.target = target;
+    return;
+  }
+  if( spi.state==target )
+    return;
+
+  switch( spi.state ) {
+  case CC_STATE_IDLE:
+    if( ( spi.regs[ CC1100_MCSM0 ] & 0x30 )==0x10 )  // FS_AUTOCAL from IDLE
+      spi_host_transient( CC_STATE_CALIBRATE, CC_CAL_US, target );
+    else
+      spi_host_transient( CC_STATE_SETTLING, CC_SETTLE_US, target );
+    break;
+  case CC_STATE_RX:
+  case CC_STATE_TX:
+  case CC_STATE_FSTXON:
+    spi_host_transient( CC_STATE_SETTLING, CC_TURNAROUND_US, target );
+    break;
+  }
+}
+
+// End of a fixed length packet, MCSM1 TXOFF_MODE
+static void spi_host_tx_off(void) {
+  switch( spi.regs[ CC1100_MCSM1 ] & 0x03 ) {
+  case 1:  spi_host_set_state( CC_STATE_FSTXON ); break;
+  case 2:  break;
+  case 3:  spi_host_transient( CC_STATE_SETTLING, CC_TURNAROUND_US, CC_STATE_RX ); break;
+  default: spi_host_set_state( CC_STATE_IDLE );   break;
+  }
+}
+
+static void spi_host_strobe( uint8_t strobe ) {
+  switch( strobe ) {
+  case CC1100_SRES:
+    memset( spi.regs, 0, sizeof(spi.regs) );
+    spi.regs[ CC1100_IOCFG2 ]  = 0x29;
+    spi.regs[ CC1100_IOCFG0 ]  = 0x3F;
+    spi.regs[ CC1100_FIFOTHR ] = 0x07;
+    spi.regs[ CC1100_SYNC1 ]   = 0xD3;
+    spi.regs[ CC1100_SYNC0 ]   = 0x91;
+    spi.regs[ CC1100_PKTLEN ]  = 0xFF;
+    spi.regs[ CC1100_PKTCTRL0 ]= 0x45;
+    spi.regs[ CC1100_MCSM0 ]   = 0x04;
+    spi_host_rx_flush();
+    spi_host_tx_flush();
+    spi.due = 0;
+    spi_host_set_state( CC_STATE_IDLE );
+    spi.ready = host_now() + US_CYCLES( CC_RESET_US );
+    break;
+  case CC1100_SIDLE:
+    spi.due = 0;
+    spi_host_set_state( CC_STATE_IDLE );
+    break;
+  case CC1100_SCAL:
+    if( spi.state==CC_STATE_IDLE && !spi.due )
+      spi_host_transient( CC_STATE_CALIBRATE, CC_CAL_US, CC_STATE_IDLE );
+    break;
+  case CC1100_SFSTXON:  spi_host_go( CC_STATE_FSTXON ); break;
+  case CC1100_STX:      spi_host_go( CC_STATE_TX );     break;
+  case CC1100_SRX:      spi_host_go( CC_STATE_RX );     break;
+  case CC1100_SFTX:
+    if( spi.state==CC_STATE_IDLE || spi.state==CC_STATE_TX_UNDERFLOW )
+      spi_host_tx_flush();
+    break;
+  case CC1100_SFRX:
+    if( spi.state==CC_STATE_IDLE || spi.state==CC_STATE_RX_OVERFLOW )
+      spi_host_rx_flush();
+    break;
+  }
+}
+
+/***************************************************************
+** Register access
+*/
+static uint8_t spi_host_rx_pop(void) {
+  uint8_t byte = 0;
+
+  if( spi.rxCount ) {
+    byte = spi.rxFifo[ spi.rxHead ];
+    spi.rxHead = ( spi.rxHead+1 ) % CC_FIFO_SIZE;
+    spi.rxCount--;
+  }
+
+  return byte;
+}
+
+static void spi_host_tx_push( uint8_t byte ) {
+  if( spi.txCount < CC_FIFO_SIZE ) {
+    spi.txFifo[ ( spi.txHead + spi.txCount ) % CC_FIFO_SIZE ] = byte;
+    spi.txCount++;
+  }
+}
+
+static uint8_t spi_host_marcstate(void) {
+  switch( spi.state ) {
+  case CC_STATE_RX:            return CC_MARCSTATE_RX;
+  case CC_STATE_TX:            return CC_MARCSTATE_TX;
+  case CC_STATE_FSTXON:        return CC_MARCSTATE_FSTXON;
+  case CC_STATE_CALIBRATE:     return ( spi.target==CC_STATE_IDLE ) ? CC_MARCSTATE_MANCAL : CC_MARCSTATE_STARTCAL;
+  case CC_STATE_SETTLING:      return CC_MARCSTATE_FS_LOCK;
+  case CC_STATE_RX_OVERFLOW:   return CC_MARCSTATE_RXFIFO_OVERFLOW;
+  case CC_STATE_TX_UNDERFLOW:  return CC_MARCSTATE_TXFIFO_UNDERFLOW;
+  default:                     return CC_MARCSTATE_IDLE;
+  }
+}
+
+// Carrier sense and clear channel assessment only mean anything in RX
+static uint8_t spi_host_carrier(void) {
+  return spi.state==CC_STATE_RX && host_air_carrier();
+}
+
+static uint8_t spi_host_cca(void) {
+  if( spi.state!=CC_STATE_RX ) return 0;
+  switch( ( spi.regs[ CC1100_MCSM1 ] >> 4 ) & 0x03 ) {
+  case 0:  return 1;                      // Always
+  default: return !spi_host_carrier();    // RSSI below threshold
+  }
+}
+
+static uint8_t spi_host_status_reg( uint8_t addr ) {
+  switch( addr ) {
+  case CC1100_RXBYTES & 0x3F:
+    return spi.rxCount | ( ( spi.state==CC_STATE_RX_OVERFLOW ) ? 0x80 : 0 );
+  case CC1100_TXBYTES & 0x3F:
+    return spi.txCount | ( ( spi.state==CC_STATE_TX_UNDERFLOW ) ? 0x80 : 0 );
+  case CC1100_MARCSTATE & 0x3F:
+    return spi_host_marcstate();
+  case CC1100_RSSI & 0x3F:
+    if( spi.state==CC_STATE_RX )
+      spi.status[ addr & 0x0F ] = spi_host_carrier() ? CC_RSSI_CARRIER : CC_RSSI_NOISE;
+    return spi.status[ addr & 0x0F ];
+  case CC1100_PKTSTATUS & 0x3F:
+    return ( spi_host_carrier() ? CC_PKTSTATUS_CS : 0 ) | ( spi_host_cca() ? CC_PKTSTATUS_CCA : 0 );
+  default:
+    return spi.status[ addr & 0x0F ];
+  }
+}
+
+void spi_init(void) {
+  memset( &spi, 0, sizeof(spi) );
+
+  spi.status[ CC1100_PARTNUM & 0x0F ] = 0x00;
+  spi.status[ CC1100_VERSION & 0x0F ] = 0x14;
+  spi.status[ CC1100_RSSI & 0x0F ]    = CC_RSSI_NOISE;
+}
+
+void spi_deassert(void) {
+  spi.cs = 0;
+}
+
+void spi_assert(void) {
+  spi.cs = 1;
+  spi.count = 0;
+}
+
+uint8_t spi_check_miso(void) {
+  host_delay_us( CC_MISO_POLL_US );
+  return host_now() < spi.ready;
+}
+
+uint8_t spi_send(uint8_t data) {
+  uint8_t result;
+
+  host_delay_us( CC_SPI_BYTE_US );
+  host_cc_update();
+
+  result = spi.state;
+  if( spi.count==0 ) {
+    uint8_t addr = data & 0x3F;
+
+    spi.header = data;
+    if( addr >= CC_STATUS_REG && addr < CC1100_PATABLE && !( data & CC_BURST ) )
+      spi_host_strobe( addr );
+  } else {
+    uint8_t addr = spi.header & 0x3F;
+
+    if( addr==CC1100_FIFO ) {
+      if( spi.header & CC_READ )
+        result = spi_host_rx_pop();
+      else
+        spi_host_tx_push( data );
+    } else if( addr >= CC_STATUS_REG && addr < CC1100_PATABLE ) {
+      result = spi_host_status_reg( addr );
+    } else {
+      if( spi.header & CC_BURST ) addr += spi.count-1;
+      addr &= 0x3F;
+      if( spi.header & CC_READ )
+        result = spi.regs[ addr ];
+      else
+        spi.regs[ addr ] = data;
+    }
+  }
+  spi.count++;
+
+  return result;
+}
+
+uint8_t spi_strobe(uint8_t b) {
+  uint8_t result;
+  spi_assert();
+  result = spi_send(b);
+  spi_deassert();
+  return result;
+}
+
+/***************************************************************
+** GDO pins
+*/
+static uint8_t spi_host_gdo( uint8_t cfg, uint8_t data ) {
+  uint8_t level = 0;
+
+  switch( cfg & 0x3F ) {
+  case 0x00:  // RX FIFO at or above threshold
+    level = spi.rxCount >= ( ( spi.regs[ CC1100_FIFOTHR ] & 0x0F ) + 1 ) * 4;
+    break;
+  case 0x02:  // TX FIFO at or above threshold
+    level = spi.txCount >= 61 - 4 * ( spi.regs[ CC1100_FIFOTHR ] & 0x0F );
+    break;
+  case 0x09:  // Clear channel assessment
+    level = spi_host_cca();
+    break;
+  case 0x0D:  // Serial data output
+    level = ( spi.state==CC_STATE_RX ) ? data : 0;
+    break;
+  case 0x0E:  // Carrier sense
+    level = spi_host_carrier();
+    break;
+  case 0x2E:  // High impedance
+    return 0;
+  }
+
+  if( cfg & 0x40 ) level = !level;
+  return level;
+}
+
+// GDO2 pin given the demodulated signal
+uint8_t host_cc_gdo2( uint8_t data ) {
+  host_cc_update();
+  return spi_host_gdo( spi.regs[ CC1100_IOCFG2 ], data );
+}
+
+// GDO0 pin
+uint8_t host_cc_gdo0(void) {
+  host_cc_update();
+  return spi_host_gdo( spi.regs[ CC1100_IOCFG0 ], 0 );
+}
+
+/***************************************************************
+** Demodulator, called by hal_host.c
+*/
+
+// Are demodulated bits wanted by the packet handler?
+uint8_t host_cc_rx_sampling(void) {
+  host_cc_update();
+  return spi.state==CC_STATE_RX && ( spi.regs[ CC1100_PKTCTRL0 ] & 0x30 )==0x00;
+}
+
+static uint8_t host_cc_sync_found(void) {
+  uint16_t sync = ( spi.regs[ CC1100_SYNC1 ]<<8 ) | spi.regs[ CC1100_SYNC0 ];
+  uint16_t diff = spi.syncShift ^ sync;
+  uint8_t errors = 0;
+
+  while( diff ) {
+    errors += diff & 1;
+    diff >>= 1;
+  }
+
+  switch( spi.regs[ CC1100_MDMCFG2 ] & 0x03 ) {
+  case 0:  return 1;               // No sync word
+  case 1:  return errors <= 1;     // 15/16
+  default: return errors == 0;     // 16/16 (30/32 treated as 16/16)
+  }
+}
+
+void host_cc_rx_bit( uint8_t bit ) {
+  if( !spi.synced ) {
+    spi.syncShift = ( spi.syncShift<<1 ) | ( bit ? 1 : 0 );
+    if( host_cc_sync_found() ) {
+      spi.synced = 1;
+      spi.rxBits = 0;
+    }
+    return;
+  }
+
+  spi.rxByte = ( spi.rxByte<<1 ) | ( bit ? 1 : 0 );
+  if( ++spi.rxBits == 8 ) {
+    spi.rxBits = 0;
+    if( spi.rxCount < CC_FIFO_SIZE ) {
+      spi.rxFifo[ ( spi.rxHead + spi.rxCount ) % CC_FIFO_SIZE ] = spi.rxByte;
+      spi.rxCount++;
+    } else {
+      spi_host_set_state( CC_STATE_RX_OVERFLOW );
+    }
+  }
+}
+
+/***************************************************************
+** Modulator, called by hal_host.c
+*/
+
+// Is GDO0 being sent in asynchronous serial mode?
+uint8_t host_cc_tx_async(void) {
+  return spi.state==CC_STATE_TX && ( spi.regs[ CC1100_PKTCTRL0 ] & 0x30 )==0x30;
+}
+
+// Is the packet handler sending the TX FIFO?
+uint8_t host_cc_tx_sending(void) {
+  return spi.state==CC_STATE_TX && ( spi.regs[ CC1100_PKTCTRL0 ] & 0x30 )==0x00;
+}
+
+// Next bit on air
+uint8_t host_cc_tx_bit(void) {
+  uint8_t bit;
+
+  if( spi.txBits==0 ) {
+    uint8_t fixed = ( spi.regs[ CC1100_PKTCTRL0 ] & 0x03 )==0x00;
+
+    if( fixed && spi.txSent==spi.regs[ CC1100_PKTLEN ] ) {
+      spi_host_tx_off();
+      return 0;
+    }
+    if( !spi.txCount ) {
+      spi_host_set_state( CC_STATE_TX_UNDERFLOW );
+      return 0;
+    }
+
+    spi.txByte = spi.txFifo[ spi.txHead ];
+    spi.txHead = ( spi.txHead+1 ) % CC_FIFO_SIZE;
+    spi.txCount--;
+    spi.txSent++;
+    spi.txBits = 8;
+  }
+
+  bit = ( spi.txByte & 0x80 ) ? 1 : 0;
+  spi.txByte <<= 1;
+  spi.txBits--;
+
+  return bit;
+}
+
+/***************************************************************
+** Statistics
+*/
+static void host_cc_report_turnaround( char const *name, struct spi_host_turnaround *t ) {
+  if( t->n )
+    fprintf( stderr, "# host: CC1101 %s %u times, mean %.1f us, max %.1f us\n", name, t->n,
+             (double)t->total / t->n / ( F_CPU / 1000000 ), (double)t->max / ( F_CPU / 1000000 ) );
+}
+
+void host_cc_report(void) {
+  host_cc_report_turnaround( "RX->TX", &spi.rxToTx );
+  host_cc_report_turnaround( "TX->RX", &spi.txToRx );
+  fprintf( stderr, "# host: CC1101 %u calibrations\n", spi.nCal );
+  if( spi.nTxBusy )
+    fprintf( stderr, "# host: CC1101 TX started over a carrier %u times\n", spi.nTxBusy );
+}
@@ -0,0 +1,221 @@
+/***************************************************************
+** fmt_bench.c
+**
+** Host benchmark of the message printer's field formatting
+**
+** The fields of an RQ message with a 22 byte payload are formatted
+** with the msg_print_*() functions of message.c, which use fmt.c,
+** and with the sprintf_P versions they replaced. The two lines must
+** be identical. Each is formatted 20000 times per run and the best
+** run is reported per message.
+**
+** These are host times and the host sprintf is not avr-libc's. The
+** flash saved is measured on the AVR build, where vfprintf is no
+** longer linked: compare avr-size of the firmware before and after.
+**
+** Build from the top directory, message.c is included here so its
+** statics can be reached:
+**
+**   gcc -DHOST_BUILD -Ihost -I. -O2 -Wall -o fmt_bench host/test/fmt_bench.c \
+**       $(ls *.c host/[a-z]*.c | grep -v '^message.c$') -lm
+**   ./fmt_bench [runs]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "message.c"
+
+#define N_MSGS 20000
+
+/***************************************************************
+** The fields before fmt.c, unchanged apart from their names
+*/
+#define sprintf_P sprintf
+
+static uint8_t msg_print_rssi_old( char *str, uint8_t rssi, uint8_t valid ) {
+  uint8_t n = 0;
+
+  if( valid ) {
+    n = sprintf_P(str, PSTR("%03u "), rssi );
+  } else {
+    n = sprintf_P(str, PSTR("--- "));
+  }
+
+  return n;
+}
+
+static uint8_t msg_print_type_old( char *str, uint8_t type ) {
+  uint8_t n = 0;
+
+ n = sprintf_P( str,PSTR("%2s "),MsgType[type] );
+
+  return n;
+}
+
+static uint8_t msg_print_addr_old( char *str, uint8_t *addr, uint8_t valid ) {
+  uint8_t n = 0;
+
+  if( valid ) {
+    uint8_t  class =         ( addr[0] & 0xFC ) >>  2;
+    unsigned long dev = (uint32_t)( addr[0] & 0x03 ) << 16
+                 | (uint32_t)( addr[1]        ) <<  8
+                 | (uint32_t)( addr[2]        )       ;
+
+    n = sprintf_P(str, PSTR("%02hu:%06lu "), class, dev );
+  } else {
+    n = sprintf_P(str, PSTR("--:------ "));
+  }
+
+  return n;
+}
+
+static uint8_t msg_print_param_old( char *str, uint8_t param, uint8_t valid ) {
+  uint8_t n = 0;
+
+  if( valid ) {
+    n = sprintf_P(str, PSTR("%03u "), param );
+  } else {
+    n = sprintf_P(str, PSTR("--- "));
+  }
+
+  return n;
+}
+
+static uint8_t msg_print_opcode_old( char *str, uint8_t *opcode, uint8_t valid ) {
+  uint8_t n = 0;
+
+  if( valid ) {
+    n = sprintf_P( str, PSTR("%02X%02X "), opcode[0],opcode[1] );
+  } else {
+    n= sprintf_P(str, PSTR("???? "));
+  }
+
+  return n;
+}
+
+static uint8_t msg_print_len_old( char *str, uint8_t len, uint8_t valid ) {
+  uint8_t n = 0;
+
+  if( valid ) {
+    n = sprintf_P(str, PSTR("%03u "), len );
+  } else {
+    n = sprintf_P(str, PSTR("??? "));
+  }
+
+  return n;
+}
+
+static uint8_t msg_print_payload_old( char *str, uint8_t payload ) {
+  uint8_t n=0;
+
+  n = sprintf_P( str,PSTR("%02X"),payload );
+
+  return n;
+}
+
+#undef sprintf_P
+
+/***************************************************************
+** RQ --- 18:000730 01:090623 --:------ 1F09 022 <22 bytes>
+*/
+static uint8_t bench_addr[3][3] = {
+  { 18<<2, 0x02, 0xDA },                       // 18:000730
+  { ( 1<<2 ) | 0x01, 0x61, 0xFF },             // 01:090623
+  { 0, 0, 0 }
+};
+static uint8_t bench_opcode[2] = { 0x1F, 0x09 };
+static uint8_t bench_payload[22] = {
+  0x6B, 0x30, 0xF9, 0x0E, 0xC7, 0xDD, 0x01, 0xE4, 0x88, 0x75, 0x34,
+  0xA2, 0x0F, 0x0B, 0x0D, 0x04, 0xC3, 0x6E, 0xD8, 0x0E, 0x71, 0xE0
+};
+
+static uint8_t bench_line_old( char *str ) {
+  uint8_t n = 0, i;
+
+  n += msg_print_rssi_old( str+n, 50, 1 );
+  n += msg_print_type_old( str+n, 0 );
+  n += msg_print_param_old( str+n, 0, 0 );
+  n += msg_print_addr_old( str+n, bench_addr[0], 1 );
+  n += msg_print_addr_old( str+n, bench_addr[1], 1 );
+  n += msg_print_addr_old( str+n, bench_addr[2], 0 );
+  n += msg_print_opcode_old( str+n, bench_opcode, 1 );
+  n += msg_print_len_old( str+n, sizeof(bench_payload), 1 );
+  for( i=0 ; i<sizeof(bench_payload) ; i++ )
+    n += msg_print_payload_old( str+n, bench_payload[i] );
+  n += sprintf( str+n, "\r\n" );
+
+  return n;
+}
+
+static uint8_t bench_line_new( char *str ) {
+  uint8_t n = 0, i;
+
+  n += msg_print_rssi( str+n, 50, 1 );
+  n += msg_print_type( str+n, 0 );
+  n += msg_print_param( str+n, 0, 0 );
+  n += msg_print_addr( str+n, bench_addr[0], 1 );
+  n += msg_print_addr( str+n, bench_addr[1], 1 );
+  n += msg_print_addr( str+n, bench_addr[2], 0 );
+  n += msg_print_opcode( str+n, bench_opcode, 1 );
+  n += msg_print_len( str+n, sizeof(bench_payload), 1 );
+  for( i=0 ; i<sizeof(bench_payload) ; i++ )
+    n += msg_print_payload( str+n, bench_payload[i] );
+  n += msg_print_error( str+n, 0 );
+
+  return n;
+}
+
+/***************************************************************
+** Timing
+*/
+static volatile uint8_t sink;
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static double bench_run( uint8_t (*line)( char *str ) ) {
+  static char str[128];
+  double t0 = bench_now();
+  uint8_t x = 0;
+  uint32_t i;
+
+  for( i=0 ; i<N_MSGS ; i++ )
+    x ^= line( str );
+  sink = x ^ str[0];
+
+  return ( bench_now() - t0 ) / N_MSGS;
+}
+
+int main( int argc, char *argv[] ) {
+  char strOld[128], strNew[128];
+  uint8_t nOld, nNew;
+  double bestOld = 1e30, bestNew = 1e30;
+  int runs = 20;
+  int r;
+
+  if( argc > 1 ) runs = atoi( argv[1] );
+
+  nOld = bench_line_old( strOld );
+  nNew = bench_line_new( strNew );
+  if( nOld!=nNew || memcmp( strOld, strNew, nOld ) ) {
+    fprintf( stderr, "lines differ:\n%.*s%.*s", nOld, strOld, nNew, strNew );
+    return 2;
+  }
+  printf( "%.*s", nNew, strNew );
+
+  for( r=0 ; r<runs ; r++ ) {
+    double t;
+    t = bench_run( bench_line_old ); if( t < bestOld ) bestOld = t;
+    t = bench_run( bench_line_new ); if( t < bestNew ) bestNew = t;
+  }
+
+  printf( "%u characters, %d messages, best of %d runs:\n", nNew, N_MSGS, runs );
+  printf( "  sprintf_P %7.1f ns/message\n", bestOld );
+  printf( "  fmt       %7.1f ns/message\n", bestNew );
+
+  return 0;
+}
@@ -0,0 +1,382 @@
+/***************************************************************
+** msg_stress.c
+**
+** Host stress test of the RX message handoff described under
+** "RX work message" in message.c
+**
+** The decode ISR fills the RX work message a byte at a time while
+** the main loop commits, takes and frees arena records. Here the
+** ISR fires a random 1-3 times between every main loop operation,
+** so frames start, run and end at every point of the arena
+** operations' sequence. The main loop ops are those of msg_work()
+** and frame_rx_done(): msg_rx_end() (with and without a TRC_CUT
+** live record), msg_rx_get(), msg_tx_ready(), msg_tx_get() and
+** msg_free(), with records held for a while before being freed.
+**
+** The ISR path must leave every byte of the arena alone and the
+** main loop must leave the RX work message alone while the ISR
+** owns it. Both are checked around every step, which covers an
+** interrupt at any instruction boundary inside them. Each message
+** carries its own id and a pattern derived from it, and is checked
+** when it is taken and again when it is freed: every one committed
+** must come out exactly once and intact, and the arena must be
+** empty at the end.
+**
+** Build from the top directory, message.c is included here so its
+** statics can be reached:
+**
+**   gcc -DHOST_BUILD -Ihost -I. -O2 -Wall -o msg_stress host/test/msg_stress.c \
+**       $(ls *.c host/[a-z]*.c | grep -v '^message.c$') -lm
+**   ./msg_stress [steps] [seed]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "message.c"
+
+#define TEST_FIELDS ( F_I | F_ADDR0 | F_ADDR2 )
+
+enum id_state { ID_NONE, ID_QUEUED, ID_TAKEN, ID_DROPPED };
+
+static struct stress {
+  uint32_t seed;
+  uint32_t step;
+
+  uint8_t *rxState;  // enum id_state of each RX id
+  uint8_t *txState;  // and TX id
+  uint32_t nRx;
+  uint32_t nTx;
+  uint32_t rxDropped;
+  uint32_t txFull;
+  uint32_t live;
+
+  struct message *rxHeld;  // Being "printed"
+  struct message *txHeld;  // Being "sent"
+  uint16_t rxHold;
+  uint16_t txHold;
+} st;
+
+static uint32_t rnd( uint32_t n ) {
+  st.seed = st.seed * 1103515245 + 12345;
+  return ( ( st.seed >> 16 ) & 0x7FFF ) % n;
+}
+
+static void fail( char const *what, uint32_t id ) {
+  fprintf( stderr, "FAIL step %u: %s (id %u)\n", st.step, what, id );
+  exit( 1 );
+}
+
+/***************************************************************
+** Test messages
+** The id is in the first four payload bytes and picks the length
+** and the rest of the payload
+*/
+static uint8_t test_len( uint32_t id ) { return 4 + id % ( MAX_PAYLOAD-3 ); }
+static uint8_t test_byte( uint32_t id, uint8_t i ) { return (uint8_t)( id*7 + i*13 + 1 ); }
+
+static void test_addr( uint32_t id, uint8_t *addr, uint8_t n ) {
+  uint16_t dev = (uint16_t)( id + n );
+  addr[0] = 18<<2;
+  addr[1] = dev >> 8;
+  addr[2] = dev & 0xFF;
+}
+
+// Packet bytes, header through checksum
+static uint8_t test_packet( uint32_t id, uint8_t *bytes ) {
+  uint8_t n = 0, i, csum = 0;
+
+  bytes[n++] = get_header( TEST_FIELDS );
+  test_addr( id, bytes+n, 0 ); n += 3;
+  test_addr( id, bytes+n, 2 ); n += 3;
+  bytes[n++] = 0x1F;
+  bytes[n++] = 0x09;
+  bytes[n++] = test_len( id );
+  for( i=0 ; i<test_len( id ) ; i++ )
+    bytes[n++] = ( i<4 ) ? ( id >> ( 8*i ) ) & 0xFF : test_byte( id, i );
+  for( i=0 ; i<n ; i++ )
+    csum += bytes[i];
+  bytes[n++] = -csum;
+
+  return n;
+}
+
+static uint32_t test_check( struct message *msg, char const *which ) {
+  uint32_t id;
+  uint8_t addr[3];
+  uint8_t i;
+
+  if( msg->nPayload < 4 )
+    fail( which, 0 );
+  id = msg->payload[0] | ( msg->payload[1]<<8 ) | ( (uint32_t)msg->payload[2]<<16 ) | ( (uint32_t)msg->payload[3]<<24 );
+
+  if( msg->error!=MSG_OK || ( msg->fields & ( F_MASK | F_OPTION ) )!=TEST_FIELDS )
+    fail( "bad header or error", id );
+  test_addr( id, addr, 0 );
+  if( memcmp( msg->addr[0], addr, 3 ) )
+    fail( "bad addr0", id );
+  test_addr( id, addr, 2 );
+  if( memcmp( msg->addr[2], addr, 3 ) )
+    fail( "bad addr2", id );
+  if( msg->opcode[0]!=0x1F || msg->opcode[1]!=0x09 )
+    fail( "bad opcode", id );
+  if( msg->len!=test_len( id ) || msg->nPayload!=msg->len )
+    fail( "bad length", id );
+  for( i=4 ; i<msg->nPayload ; i++ )
+    if( msg->payload[i]!=test_byte( id, i ) )
+      fail( "payload overwritten", id );
+
+  return id;
+}
+
+static void test_take( uint8_t *state, uint32_t n, uint32_t id ) {
+  if( id>=n || state[id]==ID_NONE )
+    fail( "message never committed", id );
+  if( state[id]!=ID_QUEUED )
+    fail( "message taken twice", id );
+  state[id] = ID_TAKEN;
+}
+
+/***************************************************************
+** Arena walk, from the tail over every used byte
+*/
+static void arena_check(void) {
+  uint16_t pos = arena.tail;
+  uint16_t left = arena.used;
+
+  if( arena.used > MSG_ARENA )
+    fail( "arena overfull", arena.used );
+
+  while( left ) {
+    uint16_t skip = msg_arena_skip( pos );
+    if( skip ) {
+      if( skip > left ) fail( "arena skip past head", pos );
+      pos = 0;
+      left -= skip;
+    } else {
+      struct msg_rec *rec = (struct msg_rec *)( arena.buf + pos );
+      if( rec->size < REC_MIN || rec->size > left || pos + rec->size > MSG_ARENA )
+        fail( "bad record size", pos );
+      if( rec->list > L_BUSY )
+        fail( "bad record list", pos );
+      pos += rec->size;
+      if( pos==MSG_ARENA ) pos = 0;
+      left -= rec->size;
+    }
+  }
+
+  if( arena.used && pos!=arena.head )
+    fail( "arena head mismatch", pos );
+}
+
+/***************************************************************
+** Decode ISR
+** msg_rx_start() and msg_rx_byte() as frame_rx_byte() calls them,
+** one byte per interrupt. Once the frame has ended it waits for
+** the main loop's msg_rx_end(), as RX stays off until then.
+*/
+static struct isr {
+  uint8_t live;
+  uint8_t ended;
+  uint8_t n;
+  uint8_t nBytes;
+  uint8_t bytes[MAX_PAYLOAD+16];
+} isr;
+
+static uint8_t arenaCopy[sizeof(arena)];
+
+static void isr_fire(void) {
+  memcpy( arenaCopy, &arena, sizeof(arena) );
+
+  if( !isr.live ) {
+    if( st.nRx < st.step+1 ) {
+      msg_rx_start();
+      isr.nBytes = test_packet( st.nRx, isr.bytes );
+      isr.n = 0;
+      isr.live = 1;
+    }
+  } else if( !isr.ended ) {
+    if( msg_rx_byte( isr.bytes[isr.n++] )!=MSG_OK )
+      fail( "decode error", st.nRx );
+    if( isr.n==isr.nBytes )
+      isr.ended = 1;
+  }
+
+  if( memcmp( arenaCopy, &arena, sizeof(arena) ) )
+    fail( "ISR changed the arena", st.nRx );
+}
+
+/***************************************************************
+** Main loop operations
+*/
+static void main_rx_done(void) {
+  uint16_t used = arena.used;
+  uint8_t cut = ( rxLiveRec!=NULL );
+
+  msg_rx_rssi( 50 );
+  msg_rx_end( 0, MSG_OK );
+
+  if( cut ) {  // Already had its record, now being printed
+    if( rxPrint==NULL || rxPrint==msgRx )
+      fail( "live record not handed over", st.nRx );
+    st.rxHeld = rxPrint;
+    rxPrint = NULL;
+    st.rxHold = rnd( 8 );
+    st.rxState[st.nRx] = ID_QUEUED;
+    test_take( st.rxState, st.step+1, test_check( st.rxHeld, "live RX" ) );
+  } else if( arena.used!=used ) {
+    st.rxState[st.nRx] = ID_QUEUED;
+  } else {
+    st.rxState[st.nRx] = ID_DROPPED;  // Arena full
+    st.rxDropped++;
+  }
+
+  st.nRx++;
+  isr.live = isr.ended = 0;
+}
+
+static void main_rx_live(void) {
+  rxLiveRec = msg_reserve( MAX_PAYLOAD+MAX_RAW, 0 );
+  if( rxLiveRec ) {
+    rxLiveRec->list = L_BUSY;
+    rxPrint = msgRx;
+    st.live++;
+  }
+}
+
+static void main_tx_commit(void) {
+  static uint8_t payload[TX_RAW_BUF];
+  static struct message tx = { .payload=payload };
+  uint8_t bytes[MAX_PAYLOAD+16];
+  uint8_t i, n;
+
+  msg_reset( &tx );
+  n = test_packet( st.nTx, bytes );
+  tx.fields = TEST_FIELDS;
+  tx.rxFields = TEST_FIELDS | F_OPCODE | F_LEN;
+  memcpy( tx.addr[0], bytes+1, 3 );
+  memcpy( tx.addr[2], bytes+4, 3 );
+  tx.opcode[0] = bytes[7];
+  tx.opcode[1] = bytes[8];
+  tx.len = bytes[9];
+  for( i=0 ; i<tx.len ; i++ )
+    tx.payload[tx.nPayload++] = bytes[10+i];
+  tx.csum = bytes[n-1];
+  tx.state = S_COMPLETE;
+
+  if( msg_tx_ready( &tx ) ) {
+    st.txState[st.nTx++] = ID_QUEUED;
+  } else {
+    st.txFull++;
+  }
+}
+
+static void main_op(void) {
+  switch( rnd( 6 ) ) {
+  case 0:
+    if( isr.ended )
+      main_rx_done();
+    break;
+
+  case 1:  // Start printing, from msg_work()
+    if( !st.rxHeld && !rxLiveRec ) {
+      st.rxHeld = msg_rx_get();
+      if( st.rxHeld ) {
+        st.rxHold = rnd( 8 );
+        test_take( st.rxState, st.step+1, test_check( st.rxHeld, "RX" ) );
+      } else if( isr.live && !isr.ended && rnd( 2 ) ) {
+        main_rx_live();
+      }
+    }
+    break;
+
+  case 2:
+    if( st.rxHeld && !st.rxHold-- ) {
+      test_check( st.rxHeld, "RX freed" );
+      msg_free( &st.rxHeld );
+    }
+    break;
+
+  case 3:
+    if( st.nTx < st.step+1 )
+      main_tx_commit();
+    break;
+
+  case 4:
+    if( !st.txHeld ) {
+      st.txHeld = msg_tx_get();
+      if( st.txHeld ) {
+        st.txHold = rnd( 8 );
+        test_take( st.txState, st.nTx, test_check( st.txHeld, "TX" ) );
+      }
+    }
+    break;
+
+  case 5:
+    if( st.txHeld && !st.txHold-- ) {
+      test_check( st.txHeld, "TX freed" );
+      msg_free( &st.txHeld );
+    }
+    break;
+  }
+}
+
+static struct message rxCopy;
+static uint8_t rxPayloadCopy[MAX_PAYLOAD];
+
+int main( int argc, char *argv[] ) {
+  uint32_t steps = ( argc > 1 ) ? strtoul( argv[1], NULL, 0 ) : 1000000;
+  uint32_t i;
+
+  st.seed = ( argc > 2 ) ? strtoul( argv[2], NULL, 0 ) : 1;
+  st.rxState = calloc( steps+2, 1 );
+  st.txState = calloc( steps+2, 1 );
+  if( get_header( TEST_FIELDS )==0xFF || !st.rxState || !st.txState )
+    fail( "setup", 0 );
+
+  for( st.step=0 ; st.step<steps ; st.step++ ) {
+    uint8_t owned;
+
+    for( i=1+rnd( 3 ) ; i ; i-- )
+      isr_fire();
+
+    // The ISR owns the work message from msg_rx_start() to the frame end
+    owned = isr.live && !isr.ended;
+    memcpy( &rxCopy, msgRx, sizeof(rxCopy) );
+    memcpy( rxPayloadCopy, rxPayload, sizeof(rxPayloadCopy) );
+
+    main_op();
+    arena_check();
+
+    if( owned && ( memcmp( &rxCopy, msgRx, sizeof(rxCopy) ) || memcmp( rxPayloadCopy, rxPayload, sizeof(rxPayloadCopy) ) ) )
+      fail( "main loop changed the RX work message", st.nRx );
+  }
+
+  // Drain
+  while( isr.live && !isr.ended )
+    isr_fire();
+  if( isr.ended )
+    main_rx_done();
+  if( st.rxHeld ) msg_free( &st.rxHeld );
+  if( st.txHeld ) msg_free( &st.txHeld );
+  while( ( st.rxHeld = msg_rx_get() ) ) {
+    test_take( st.rxState, st.nRx, test_check( st.rxHeld, "RX drain" ) );
+    msg_free( &st.rxHeld );
+  }
+  while( ( st.txHeld = msg_tx_get() ) ) {
+    test_take( st.txState, st.nTx, test_check( st.txHeld, "TX drain" ) );
+    msg_free( &st.txHeld );
+  }
+
+  for( i=0 ; i<st.nRx ; i++ )
+    if( st.rxState[i]!=ID_TAKEN && st.rxState[i]!=ID_DROPPED )
+      fail( "RX message lost", i );
+  for( i=0 ; i<st.nTx ; i++ )
+    if( st.txState[i]!=ID_TAKEN )
+      fail( "TX message lost", i );
+  if( arena.used )
+    fail( "arena not empty", arena.used );
+
+  printf( "ok: %u steps, %u RX (%u dropped for space, %u cut through), %u TX (%u waited for space)\n",
+          steps, st.nRx, st.rxDropped, st.live, st.nTx, st.txFull );
+  return 0;
+}
@@ -0,0 +1,341 @@
+/***************************************************************
+** rx_bench.c
+**
+** Host benchmark of the RX byte decoder in sw_uart.c
+**
+** An edge file is run through the edge ISR's state machine and
+** the edges of every byte are kept as the edge analysis ISR would
+** see them, with the clock correction of their frame. The bytes
+** are decoded in the same order as the ISR, so the frame end
+** (0x35) is seen when it would be.
+**
+** Every byte is then decoded over and over by rx_process_edges()
+** and by the decoder it replaced, which walked the bit periods
+** between edges. The best pass of each is reported. These are
+** host times; they show the relative cost of the two decoders
+** and are not AVR cycle counts.
+**
+** The Manchester pairs of the frames, the bytes between the header
+** and the trailer, are timed the same way with frame_man_decode()
+** and with the nibble table decode it replaced.
+**
+** Build from the top directory, sw_uart.c is included here so its
+** statics can be reached:
+**
+**   gcc -DHOST_BUILD -Ihost -I. -O2 -Wall -o rx_bench host/test/rx_bench.c \
+**       $(ls *.c host/[a-z]*.c | grep -v '^sw_uart.c$') -lm
+**   ./rx_bench host/test/corpus_edges.txt [passes]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sw_uart.c"
+
+/***************************************************************
+** The decoder before the edge table, unchanged apart from its name
+*/
+static uint8_t rx_process_edges_old( uint8_t const *edges, uint8_t nEdges ) {
+  uint8_t rx_byte = 0;
+  uint8_t rx_t = 0;
+  uint8_t rx_tBit = ONE_BIT;
+  uint8_t rx_isHi = 0;
+  uint8_t rx_hi = 0;
+
+  while( nEdges-- ) {
+    uint8_t interval = *(edges++);
+
+    if( rx_tBit < TEN_BITS ) { //
+      uint8_t samples = interval - rx_t;
+      while( samples ) {
+        uint8_t tBit = rx_tBit - rx_t;
+        if( tBit > samples )
+          tBit = samples;
+
+        if( rx_isHi ) rx_hi += tBit;
+
+        rx_t += tBit;
+        samples -= tBit;
+
+        // BIT complete?
+        if( rx_t==rx_tBit ) {
+          if( rx_tBit == ONE_BIT ) { // START BIT
+          } else if( rx_tBit < TEN_BITS ) {
+            uint8_t bit = ( rx_hi > HALF_BIT ) ? 0x80 : 0x00 ;
+            rx_byte >>= 1;
+            rx_byte  |= bit;
+          }
+
+          rx_tBit += ONE_BIT;
+          rx_hi = 0;
+        }
+      }
+    }
+
+    // Edges toggle level
+    rx_isHi ^= 1;
+  }
+
+  return rx_byte;
+}
+
+/***************************************************************
+** The Manchester decode before the 256 entry table
+*/
+static uint8_t const man_decode_nibble[16] = {
+  0xF, 0xF, 0xF, 0xF, 0xF, 0x3, 0x2, 0xF,
+  0xF, 0x1, 0x0, 0xF, 0xF, 0xF, 0xF, 0xF
+};
+#define MAN_DECODE_OLD(_i) pgm_read_byte( man_decode_nibble+(_i) )
+
+static inline int manchester_code_valid( uint8_t code ) {
+ return ( MAN_DECODE_OLD( (code>>4)&0xF )!=0xF ) && ( MAN_DECODE_OLD( (code   )&0xF )!=0xF ) ;
+}
+
+static inline uint8_t manchester_decode( uint8_t byte ) {
+  uint8_t decoded;
+
+  decoded  = MAN_DECODE_OLD( ( byte    ) & 0xF );
+  decoded |= MAN_DECODE_OLD( ( byte>>4 ) & 0xF )<<2;
+
+  return decoded;
+}
+
+// Called like frame_man_decode() so both pay for a call
+static uint16_t __attribute__((noinline)) man_decode_old( uint8_t const *raw ) {
+  if( !manchester_code_valid( raw[0] ) || !manchester_code_valid( raw[1] ) )
+    return 0x100;
+
+  return ( manchester_decode( raw[0] )<<4 ) | manchester_decode( raw[1] );
+}
+
+/***************************************************************
+** Bytes as the edge analysis ISR sees them
+*/
+struct rx_rec {
+  uint8_t nEdges;
+  int8_t  corr;
+  uint8_t edges[MAX_EDGE];
+};
+
+static struct rx_rec *recs;
+static uint32_t nRecs, maxRecs;
+static uint32_t nFrames, nCodes, nEdgeTotal;
+
+// Manchester pairs of the frames
+#define FRM_HEADER 3    // 0x33 0x55 0x53 after the UART sync word
+static uint8_t *man;
+static uint32_t nMan, maxMan;
+static uint8_t frmByte;
+
+static void bench_man_byte( uint8_t byte ) {
+  if( frmByte < 255 ) frmByte++;
+  if( frmByte <= FRM_HEADER || byte==0x35 )
+    return;
+
+  if( nMan==maxMan ) {
+    maxMan = maxMan ? 2*maxMan : 4096;
+    man = realloc( man, maxMan );
+    if( !man ) { perror("realloc"); exit(1); }
+  }
+  man[nMan++] = byte;
+}
+
+static void bench_take_slots(void) {
+  if( rx.clkNew ) {
+    rx.clkNew = 0;
+    rx_clock_recover();
+  }
+
+  while( rx.tail != rx.head ) {
+    struct rx_slot *slot = rx.slot + RX_SLOT(rx.tail);
+
+    if( slot->start ) {
+      rx.clkCorr = rx.frmCorr;
+      nFrames++;
+      nMan &= ~1;   // Only whole pairs of the last frame
+      frmByte = 0;
+    }
+
+    if( slot->code ) {
+      rx.lastByte = slot->code;
+      nCodes++;
+    } else {
+      struct rx_rec *rec;
+
+      if( nRecs==maxRecs ) {
+        maxRecs = maxRecs ? 2*maxRecs : 4096;
+        recs = realloc( recs, maxRecs*sizeof(*recs) );
+        if( !recs ) { perror("realloc"); exit(1); }
+      }
+      rec = recs + nRecs++;
+      rec->nEdges = slot->nEdges;
+      rec->corr   = rx.clkCorr;
+      memcpy( rec->edges, slot->edges, slot->nEdges );
+      nEdgeTotal += slot->nEdges;
+
+      rx.lastByte = rx_process_edges( slot->edges, slot->nEdges, rx.clkCorr );
+      bench_man_byte( rx.lastByte );
+    }
+
+    rx.tail++;
+
+    // The frame layer re-arms the UART at the end of a frame or on an error
+    if( rx.lastByte==0x35 || slot->code ) {
+      rx_reset();
+      return;
+    }
+  }
+}
+
+// Edge times are in us, the RX clock runs at 2 MHz
+static void bench_load( char const *file ) {
+  FILE *fp = fopen( file, "r" );
+  char line[80];
+  uint64_t last = 0;
+
+  if( !fp ) { perror( file ); exit(1); }
+
+  rx_reset();
+  clockShift = ( F_CPU==16000000 ) ? 2 : 1;
+
+  while( fgets( line, sizeof(line), fp ) ) {
+    double us;
+    int level;
+    uint64_t ticks;
+
+    if( line[0]=='#' || sscanf( line, "%lf %d", &us, &level )!=2 )
+      continue;
+
+    ticks = (uint64_t)( us * 2 + 0.5 );
+
+    // Timer overflows since the last edge
+    while( ( last>>16 ) < ( ticks>>16 ) ) {
+      last = ( ( last>>16 ) + 1 )<<16;
+      rx.overflow += 1;
+      if( rx.overflow > 1 ) {
+        rx_edge_detected();
+        bench_take_slots();
+      }
+    }
+    last = ticks;
+
+    rx.time  = (uint16_t)ticks;
+    rx.level = level ? 1 : 0;
+    if( rx.level != rx.lastLevel ) {
+      rx_edge_detected();
+      bench_take_slots();
+    }
+  }
+
+  fclose( fp );
+  nMan &= ~1;
+}
+
+/***************************************************************
+** Timing
+*/
+static volatile uint8_t sink;
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static double bench_old(void) {
+  double t0 = bench_now();
+  uint8_t x = 0;
+  uint32_t i;
+
+  for( i=0 ; i<nRecs ; i++ )
+    x ^= rx_process_edges_old( recs[i].edges, recs[i].nEdges );
+  sink = x;
+
+  return bench_now() - t0;
+}
+
+static double bench_new(void) {
+  double t0 = bench_now();
+  uint8_t x = 0;
+  uint32_t i;
+
+  for( i=0 ; i<nRecs ; i++ )
+    x ^= rx_process_edges( recs[i].edges, recs[i].nEdges, recs[i].corr );
+  sink = x;
+
+  return bench_now() - t0;
+}
+
+static double bench_man_old(void) {
+  double t0 = bench_now();
+  uint16_t x = 0;
+  uint32_t i;
+
+  for( i=0 ; i<nMan ; i+=2 )
+    x ^= man_decode_old( man+i );
+  sink = x;
+
+  return bench_now() - t0;
+}
+
+static double bench_man_new(void) {
+  double t0 = bench_now();
+  uint16_t x = 0;
+  uint32_t i;
+
+  for( i=0 ; i<nMan ; i+=2 )
+    x ^= frame_man_decode( man+i );
+  sink = x;
+
+  return bench_now() - t0;
+}
+
+int main( int argc, char *argv[] ) {
+  int passes = 200;
+  double bestOld = 1e30, bestNew = 1e30;
+  double bestManOld = 1e30, bestManNew = 1e30;
+  uint32_t i, nDiff = 0, nManDiff = 0;
+  int p;
+
+  if( argc < 2 ) {
+    fprintf( stderr, "usage: %s <edge file> [passes]\n", argv[0] );
+    return 1;
+  }
+  if( argc > 2 ) passes = atoi( argv[2] );
+
+  bench_load( argv[1] );
+  if( !nRecs ) {
+    fprintf( stderr, "no bytes decoded\n" );
+    return 1;
+  }
+
+  for( i=0 ; i<nRecs ; i++ ) {
+    if( rx_process_edges_old( recs[i].edges, recs[i].nEdges )
+     != rx_process_edges( recs[i].edges, recs[i].nEdges, recs[i].corr ) )
+      nDiff++;
+  }
+  for( i=0 ; i<nMan ; i+=2 ) {
+    if( man_decode_old( man+i ) != frame_man_decode( man+i ) )
+      nManDiff++;
+  }
+
+  for( p=0 ; p<passes ; p++ ) {
+    double t;
+    t = bench_old(); if( t < bestOld ) bestOld = t;
+    t = bench_new(); if( t < bestNew ) bestNew = t;
+    t = bench_man_old(); if( t < bestManOld ) bestManOld = t;
+    t = bench_man_new(); if( t < bestManNew ) bestManNew = t;
+  }
+
+  printf( "frames %u, bytes %u (+%u codes), edges %u, old/new differ on %u bytes\n",
+          nFrames, nRecs, nCodes, nEdgeTotal, nDiff );
+  printf( "Manchester bytes %u, old/new differ on %u pairs\n", nMan, nManDiff );
+  printf( "best of %d passes:\n", passes );
+  printf( "  edges      old %6.2f ns/byte %6.2f ns/edge\n", bestOld/nRecs, bestOld/nEdgeTotal );
+  printf( "  edges      new %6.2f ns/byte %6.2f ns/edge\n", bestNew/nRecs, bestNew/nEdgeTotal );
+  printf( "  Manchester old %6.2f ns/byte\n", bestManOld/nMan );
+  printf( "  Manchester new %6.2f ns/byte\n", bestManNew/nMan );
+
+  return ( nDiff || nManDiff ) ? 2 : 0;
+}
@@ -0,0 +1,90 @@
+/***************************************************************
+** sync_noise.c
+**
+** Writes an edge file of bursts that pass the sync word and header
+** but carry no message, for replay by the host build with -e
+**
+** Each burst is a valid preamble, sync word and header followed by
+** 10 bytes and the trailer. Alternate bursts use random bytes and
+** random valid Manchester codes, so both the Manchester check and
+** the probe of the first message bytes are exercised. Bursts are
+** 20 ms apart.
+**
+**   gcc -O2 -Wall -o sync_noise host/test/sync_noise.c
+**   ./sync_noise [bursts] [seed] > noise.txt
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define BIT_US   ( 1e6 / 38400 )
+#define GAP_US   20000.0
+#define N_BODY   10
+
+static uint8_t const man_encode[16] = {
+  0xAA, 0xA9, 0xA6, 0xA5,  0x9A, 0x99, 0x96, 0x95,
+  0x6A, 0x69, 0x66, 0x65,  0x5A, 0x59, 0x56, 0x55
+};
+
+static uint8_t const head[] = { 0x55, 0x55, 0x55, 0x55, 0x55, 0xFF, 0x00, 0x33, 0x55, 0x53 };
+static uint8_t const tail[] = { 0x35, 0x55, 0x55, 0x55 };
+
+static uint32_t seed;
+
+static uint8_t noise_rand(void) {
+  // xorshift32
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed >> 24;
+}
+
+static double t = 1000.0;
+static int level;
+
+static void noise_bit( int bit ) {
+  if( bit != level ) {
+    level = bit;
+    printf( "%.2f %d\n", t, level );
+  }
+  t += BIT_US;
+}
+
+// 8N1, LSB first
+static void noise_byte( uint8_t byte ) {
+  uint8_t i;
+
+  noise_bit( 0 );
+  for( i=0 ; i<8 ; i++ )
+    noise_bit( ( byte>>i ) & 1 );
+  noise_bit( 1 );
+}
+
+int main( int argc, char *argv[] ) {
+  int nBursts = 1000;
+  int k;
+  uint8_t i;
+
+  if( argc > 1 ) nBursts = atoi( argv[1] );
+  seed = ( argc > 2 ) ? (uint32_t)atol( argv[2] ) : 7;
+  if( !seed ) seed = 7;
+
+  for( k=0 ; k<nBursts ; k++ ) {
+    for( i=0 ; i<sizeof(head) ; i++ )
+      noise_byte( head[i] );
+
+    for( i=0 ; i<N_BODY ; i++ )
+      noise_byte( ( k & 1 ) ? noise_rand() : man_encode[ noise_rand() & 0xF ] );
+
+    for( i=0 ; i<sizeof(tail) ; i++ )
+      noise_byte( tail[i] );
+
+    if( level ) {
+      level = 0;
+      printf( "%.2f %d\n", t, level );
+    }
+    t += GAP_US;
+  }
+
+  return 0;
+}
@@ -0,0 +1,14 @@
+/**********************************************************
+** host/util/delay.h
+**
+** Stand-in for avr-libc in the host build
+** Busy waits advance simulated time
+*/
+#ifndef _HOST_UTIL_DELAY_H_
+#define _HOST_UTIL_DELAY_H_
+
+extern void host_delay_us( double us );
+#define _delay_us(_us) host_delay_us(_us)
+#define _delay_ms(_ms) host_delay_us( (_ms)*1000.0 )
+
+#endif
@@ -4,16 +4,19 @@
 ** Packet conversion to message
 **
 ********************************************************/
+#include <stddef.h>
 #include <string.h>
-#include <stdio.h>
 
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 
 #include "config.h"
 #include "tty.h"
 #include "trace.h"
 #include "cmd.h"
+#include "cc1101.h"
+#include "fmt.h"
 
 #include "frame.h"
 #include "message.h"
@@ -37,7 +40,9 @@ enum message_state {
   S_CHECKSUM,
   S_TRAILER,
   S_COMPLETE,
-  S_ERROR
+  S_ERROR,
+  S_RAW,     // Bytes of a frame built by the host
+  S_AT       // When to send the message that follows
 };
 
 #define F_MASK  0x03
@@ -58,6 +63,11 @@ enum message_state {
 #define F_OPCODE 0x01
 #define F_LEN    0x02
 
+// How a TX message was given by the host
+#define TX_FIELDS  0  // Fields to be assembled
+#define TX_PACKET  1  // Packet bytes, header through checksum, in the payload
+#define TX_CODED   2  // Manchester coded packet bytes in the payload
+
 #define MAX_RAW 162
 #define MAX_PAYLOAD 64
 struct message {
@@ -67,6 +77,7 @@ struct message {
   uint8_t fields;  // Fields specified in header
   uint8_t rxFields;  // Fields actually received
   uint8_t error;
+  uint8_t format;
 
   uint8_t addr[3][3];
   uint8_t param[2];
@@ -78,87 +89,426 @@ struct message {
   uint8_t rssi;
 
   uint8_t nPayload;
-  uint8_t payload[MAX_PAYLOAD];
+  uint8_t *payload;
 
   uint8_t nBytes;
-  uint8_t raw[MAX_RAW];
+  uint8_t *raw;
 };
 
 static void msg_reset( struct message *msg ) {
   if( msg != NULL ) {
+    uint8_t *payload = msg->payload;
+    uint8_t *raw = msg->raw;
+
     memset( msg, 0, sizeof(*msg) );
+
+    msg->payload = payload;
+    msg->raw = raw;
   }
 }
 
 /********************************************************
-** Message lists
+** Message arena
+**
+** Messages waiting to be sent or printed are kept in a
+** ring of variable length records, in the order they
+** were committed. Each holds the decoded fields and only
+** as much payload as was received. The raw bytes are only
+** kept when there was an error or TRC_RAW is set. A TX
+** record has room for its frame to be Manchester coded in
+** place, so there's no separate TX frame buffer.
+**
+** A message is built in a full size work message and
+** committed to the arena when it is complete. Records are
+** freed in any order but their space is only reclaimed
+** once every older record has been freed too.
+**
+** Only msg_work() and frame_work() change the arena. The
+** TX ISR only reads the frame being sent, whose record
+** isn't freed until msg_tx_done(), so it needs no
+** protection.
 ********************************************************/
-#define N_MSG 4
-#define N_LIST ( N_MSG+1 ) // Queues are bigger than total number of messsages so can never be full
+#if !defined(MSG_ARENA)
+  #define MSG_ARENA 512
+#endif
+
+enum msg_list {
+  L_FREE,
+  L_PAD,    // Unused space up to the end of the arena
+  L_RX,     // Waiting to be printed
+  L_TX,     // Waiting to be sent
+  L_WAIT,   // Waiting for its time to be sent
+  L_BUSY    // Being printed or sent
+};
 
-struct msg_list {
-  struct message *msg[N_LIST];
-  uint8_t in;
-  uint8_t out;
+struct msg_rec {
+  uint16_t size;
+  uint8_t list;
+  struct message msg;
+  // Payload then raw bytes
 };
 
-void msg_put( struct msg_list *list, struct message **ppMsg, uint8_t reset ) {
-  if( ppMsg != NULL ) {
-    struct message *pMsg = (*ppMsg);
-      if( pMsg != NULL ) {
+#define REC_ALIGN        __alignof__( struct msg_rec )
+#define REC_SIZE(_n)     ( ( sizeof(struct msg_rec) + (_n) + REC_ALIGN-1 ) & ~( REC_ALIGN-1 ) )
+#define REC_MIN          REC_SIZE( 0 )
+#define MSG_REC(_msg)    ( (struct msg_rec *)( (uint8_t *)(_msg) - offsetof( struct msg_rec, msg ) ) )
+
+static struct msg_arena {
+  uint8_t  buf[MSG_ARENA] __attribute__((aligned));
+  uint16_t head;
+  uint16_t tail;
+  uint16_t used;
+} arena;
+
+// Too little space at the end of the arena for a record is skipped
+static uint16_t msg_arena_skip( uint16_t pos ) {
+  uint16_t left = MSG_ARENA - pos;
+  return ( left < (uint16_t)REC_MIN ) ? left : 0;
+}
+
+// Queued TX messages must leave room for RX and their own echoes
+#define TX_HEADROOM REC_SIZE( MAX_PAYLOAD+MAX_RAW )
+
+static struct msg_rec *msg_reserve( uint8_t nData, uint16_t headroom ) {
+  struct msg_rec *rec = NULL;
+  uint16_t size = REC_SIZE( nData );
+  uint16_t end;
 
-      if( reset )
-        msg_reset( pMsg );
+  if( !arena.used )
+    arena.head = arena.tail = 0;
 
-      list->msg[list->in] = pMsg;
-      list->in = ( list->in + 1 ) % N_LIST;
-      (*ppMsg) = NULL;
+  end = MSG_ARENA - arena.head;
+  if( end < size ) { // Won't fit before the end, pad it out and wrap
+    if( arena.used + end + size + headroom <= MSG_ARENA ) {
+      if( end >= REC_MIN ) {
+        rec = (struct msg_rec *)( arena.buf + arena.head );
+        rec->size = end;
+        rec->list = L_PAD;
+      }
+      arena.used += end;
+      arena.head = 0;
+      rec = NULL;
+    } else {
+      return NULL;
     }
   }
+
+  if( arena.used + size + headroom <= MSG_ARENA ) {
+    rec = (struct msg_rec *)( arena.buf + arena.head );
+    rec->size = size;
+    rec->list = L_FREE;
+    arena.used += size;
+    arena.head += size;
+    if( arena.head==MSG_ARENA ) arena.head = 0;
+  }
+
+  return rec;
 }
 
-static struct message *msg_get( struct msg_list *list ) {
-  struct message *msg = list->msg[ list->out ];
+// Raw bytes are only kept when they'll be printed
+static uint8_t msg_keep_raw( struct message *msg ) {
+  return ( msg->error || TRACE(TRC_RAW) ) ? msg->nBytes : 0;
+}
 
-  if( msg != NULL ) {
-    list->msg[list->out] = NULL;
-    list->out = ( list->out+1 ) % N_LIST;
-    msg->state = S_START;
+// A TX message is Manchester coded over its own record before it's
+// sent, see msg_tx_code(). This is the room that takes.
+static uint8_t msg_tx_room( struct message *msg ) {
+  uint8_t n = msg->nPayload;
+
+  if( msg->format==TX_CODED )
+    return n;
+
+  if( msg->format==TX_FIELDS ) {
+    n += 5;   // Header, opcode, len and checksum
+    if( msg->fields & F_ADDR0 )  n += 3;
+    if( msg->fields & F_ADDR1 )  n += 3;
+    if( msg->fields & F_ADDR2 )  n += 3;
+    if( msg->fields & F_PARAM0 ) n += 1;
+    if( msg->fields & F_PARAM1 ) n += 1;
   }
 
-  return msg;
+  return 2*n;
 }
 
-/********************************************************
-** Message structure pool
-********************************************************/
-static struct msg_list msg_pool;
-static void msg_free( struct message **msg ) { msg_put( &msg_pool, msg, 1 ); }
-static struct message *msg_alloc(void) {  return msg_get( &msg_pool); }
+// Copy a work message into a reserved record
+// The raw bytes go at the start of its data and the payload at the end
+static void msg_fill( struct msg_rec *rec, struct message *msg ) {
+  uint8_t *data = (uint8_t *)( rec+1 );
+  uint8_t nBytes = msg_keep_raw( msg );
+
+  rec->msg = *msg;
+  rec->msg.payload = (uint8_t *)rec + rec->size - msg->nPayload;
+  rec->msg.nBytes = nBytes;
+  rec->msg.raw = data;
+  memcpy( rec->msg.payload, msg->payload, msg->nPayload );
+  if( nBytes )
+    memcpy( rec->msg.raw, msg->raw, nBytes );
+}
 
-static void msg_create_pool(void) {
-  static struct message MSG[N_MSG];
-  uint8_t i;
-  for( i=0 ; i<N_MSG ; i++ ) {
-    struct message *msg = &MSG[i];
-    msg_free( &msg );
+static uint8_t msg_commit( struct message *msg, uint8_t list ) {
+  uint8_t nData = ( list==L_TX ) ? msg_tx_room( msg ) : msg->nPayload + msg_keep_raw( msg );
+  struct msg_rec *rec = msg_reserve( nData, ( list==L_TX ) ? TX_HEADROOM : 0 );
+
+  if( rec ) {
+    msg_fill( rec, msg );
+    rec->list = list;
+  }
+
+  return ( rec!=NULL );
+}
+
+// Oldest message on a list, now owned by the caller
+static struct message *msg_get( uint8_t list ) {
+  uint16_t pos = arena.tail;
+  uint16_t left = arena.used;
+
+  while( left ) {
+    uint16_t skip = msg_arena_skip( pos );
+    if( skip ) {
+      pos = 0;
+      left -= skip;
+    } else {
+      struct msg_rec *rec = (struct msg_rec *)( arena.buf + pos );
+      if( rec->list==list ) {
+        rec->list = L_BUSY;
+        rec->msg.state = S_START;
+        return &rec->msg;
+      }
+      pos += rec->size;
+      if( pos==MSG_ARENA ) pos = 0;
+      left -= rec->size;
+    }
+  }
+
+  return NULL;
+}
+
+static void msg_free( struct message **msg ) {
+  if( msg && (*msg) ) {
+    MSG_REC( *msg )->list = L_FREE;
+    (*msg) = NULL;
+
+    // Reclaim everything freed at the tail
+    while( arena.used ) {
+      uint16_t skip = msg_arena_skip( arena.tail );
+      if( skip ) {
+        arena.tail = 0;
+        arena.used -= skip;
+      } else {
+        struct msg_rec *rec = (struct msg_rec *)( arena.buf + arena.tail );
+        if( rec->list!=L_FREE && rec->list!=L_PAD )
+          break;
+        arena.tail += rec->size;
+        if( arena.tail==MSG_ARENA ) arena.tail = 0;
+        arena.used -= rec->size;
+      }
+    }
   }
 }
 
 /********************************************************
 ** Received Message list
 ********************************************************/
-static struct msg_list rx_list;
-static void msg_rx_ready( struct message **msg ) { msg_put( &rx_list, msg, 0 ); }
-static struct message *msg_rx_get(void) { return msg_get( &rx_list ); }
+static uint8_t msg_rx_ready( struct message *msg ) { return msg_commit( msg, L_RX ); }
+static struct message *msg_rx_get(void) { return msg_get( L_RX ); }
 
 
 /********************************************************
 ** Transmit Message list
 ********************************************************/
-static struct msg_list tx_list;
-static void msg_tx_ready( struct message **msg ) { msg_put( &tx_list, msg, 0 ); }
-static struct message *msg_tx_get(void) {  return msg_get( &tx_list ); }
+static uint8_t msg_tx_ready( struct message *msg ) { return msg_commit( msg, L_TX ); }
+static struct message *msg_tx_get(void) {  return msg_get( L_TX ); }
+
+/********************************************************
+** Delayed transmission
+**
+** The host can give a TX message a time to be sent, a
+** delay either from when the message arrives or from the
+** end of the last good frame received from an address.
+**
+** A delayed message waits in the arena, its record on
+** L_WAIT, while an entry for it sits in a timer wheel.
+** The wheel has AT_SLOTS one millisecond slots and the
+** low bits of the due time pick the slot. As the clock
+** passes each millisecond that slot's entries are checked
+** and those that are due go on the TX list. A delay is
+** limited to AT_MAX so the record doesn't hold up the
+** reuse of the arena for long.
+**
+** The milliseconds come from frame_ms() and the wheel
+** turns in msg_work(). TX is started from the main loop
+** anyway, so a timer ISR would not start it any sooner.
+**
+** A message that can't be sent at its time, because the
+** address hasn't been heard, the time has passed or the
+** delay is too long, is echoed with MSG_SCHED_ERR. One
+** that finds the wheel or the arena full waits to be
+** queued. Its due time is fixed on the first try so the
+** wait doesn't push it later, and if that time passes
+** meanwhile it is echoed with MSG_SCHED_ERR too.
+********************************************************/
+#if !defined(AT_SLOTS)
+  #define AT_SLOTS   16     // A power of 2
+#endif
+#if !defined(AT_WAITING)
+  #define AT_WAITING 4      // Messages waiting at once
+#endif
+#if !defined(AT_SOURCES)
+  #define AT_SOURCES 4      // Addresses whose last frame is timed
+#endif
+#if !defined(AT_MAX)
+  #define AT_MAX     5000   // Longest delay in ms
+#endif
+
+#define AT_NONE 0
+#define AT_NOW  1  // From when the message arrives
+#define AT_ADDR 2  // From the last frame from addr
+
+// Schedule for the next message from the host
+static struct msg_at {
+  uint8_t ref;
+  uint8_t addr[3];
+  uint16_t delay;
+  uint8_t latched;  // due has been worked out
+  uint32_t due;
+} txAt;
+
+static struct msg_at_entry {
+  struct message *msg;   // NULL when free
+  uint16_t due;
+  uint8_t next;          // Next entry in the slot +1, 0 at the end
+} atEntry[AT_WAITING];
+
+static struct msg_wheel {
+  uint8_t slot[AT_SLOTS];  // First entry +1, 0 when empty
+  uint8_t nWait;
+  uint16_t now;            // Last millisecond turned
+} wheel;
+
+static struct msg_at_source {
+  uint8_t addr[3];
+  uint32_t ms;
+} atSource[AT_SOURCES];
+
+static uint32_t rxTime;
+
+// Remember when the last good frame from its first address ended
+static void msg_at_source( struct message *msg ) {
+  struct msg_at_source *src = atSource;
+  uint8_t i;
+
+  if( msg->error!=MSG_OK || !( msg->rxFields & F_ADDR0 ) )
+    return;
+
+  for( i=0 ; i<AT_SOURCES ; i++ ) {
+    if( !memcmp( atSource[i].addr, msg->addr[0], 3 ) ) {
+      src = atSource + i;
+      break;
+    }
+    if( atSource[i].ms < src->ms )  // Replace the oldest
+      src = atSource + i;
+  }
+
+  memcpy( src->addr, msg->addr[0], 3 );
+  src->ms = rxTime;
+}
+
+static struct msg_at_source *msg_at_find( uint8_t *addr ) {
+  uint8_t i;
+
+  for( i=0 ; i<AT_SOURCES ; i++ ) {
+    if( atSource[i].ms && !memcmp( atSource[i].addr, addr, 3 ) )
+      return atSource + i;
+  }
+
+  return NULL;
+}
+
+static uint8_t msg_at_wait( struct message *msg, uint16_t due ) {
+  struct msg_rec *rec;
+  uint8_t i;
+
+  for( i=0 ; i<AT_WAITING && atEntry[i].msg ; i++ );
+  if( i==AT_WAITING )
+    return 0;
+
+  rec = msg_reserve( msg_tx_room( msg ), TX_HEADROOM );
+  if( !rec )
+    return 0;
+
+  msg_fill( rec, msg );
+  rec->list = L_WAIT;
+
+  atEntry[i].msg = &rec->msg;
+  atEntry[i].due = due;
+  atEntry[i].next = wheel.slot[ due & ( AT_SLOTS-1 ) ];
+  wheel.slot[ due & ( AT_SLOTS-1 ) ] = i+1;
+  wheel.nWait++;
+
+  return 1;
+}
+
+// Queue a complete TX message, when its schedule says
+static uint8_t msg_tx_queue( struct message *msg ) {
+  uint32_t now, due;
+  uint8_t ok;
+
+  if( txAt.ref==AT_NONE )
+    return msg_tx_ready( msg );
+
+  now = frame_ms();
+  if( !wheel.nWait )
+    wheel.now = now;
+
+  if( !txAt.latched ) {
+    struct msg_at_source *src = ( txAt.ref==AT_ADDR ) ? msg_at_find( txAt.addr ) : NULL;
+
+    if( txAt.delay > AT_MAX || ( txAt.ref==AT_ADDR && !src ) )
+      txAt.due = now-1;
+    else
+      txAt.due = ( ( src ) ? src->ms : now ) + txAt.delay;
+    txAt.latched = 1;
+  }
+  due = txAt.due;
+
+  if( (int32_t)( due - now ) < 0 ) {  // Can't be sent in time
+    msg->error = MSG_SCHED_ERR;
+    msg->nBytes = 0;
+    ok = msg_tx_ready( msg );
+  } else if( due==now ) {
+    ok = msg_tx_ready( msg );
+  } else {
+    ok = msg_at_wait( msg, due );
+  }
+
+  if( ok )
+    memset( &txAt, 0, sizeof(txAt) );
+
+  return ok;
+}
+
+// Move messages that are due to the TX list
+static void msg_at_work(void) {
+  uint16_t now = frame_ms();
+
+  while( wheel.nWait && wheel.now!=now ) {
+    uint8_t *link;
+
+    wheel.now++;
+    link = &wheel.slot[ wheel.now & ( AT_SLOTS-1 ) ];
+    while( *link ) {
+      struct msg_at_entry *entry = atEntry + (*link) - 1;
+      if( entry->due==wheel.now ) {
+        MSG_REC( entry->msg )->list = L_TX;
+        entry->msg = NULL;
+        (*link) = entry->next;
+        wheel.nWait--;
+      } else {
+        link = &entry->next;
+      }
+    }
+  }
+}
 
 /********************************************************
 ** Message Header
@@ -194,6 +544,33 @@ static uint8_t get_hdr_flags(uint8_t header ) {
   return flags;
 }
 
+// Checks on the start of a received frame before a buffer is committed to it
+uint8_t msg_rx_header_valid( uint8_t header ) {
+  return !( header & ~( HDR_T_MASK | HDR_A_MASK | HDR_PARAM0 | HDR_PARAM1 ) );
+}
+
+// Device classes seen on RAMSES II networks, one bit per class
+//   00-04 07 08 10 12 13 17 18 20-23 29-32 34 37 39-42 45 49 59 63
+// Define RX_CLASS_FILTER as 0 to accept every class
+#if !defined(RX_CLASS_FILTER)
+  #define RX_CLASS_FILTER 1
+#endif
+
+#if RX_CLASS_FILTER
+static uint8_t const rx_classes[8] PROGMEM = {
+  0x9F, 0x35, 0xF6, 0xE0, 0xA5, 0x27, 0x02, 0x88
+};
+
+uint8_t msg_rx_class_valid( uint8_t addr ) {
+  uint8_t class = addr >> 2;
+  return pgm_read_byte( rx_classes + ( class>>3 ) ) & ( 1 << ( class & 7 ) );
+}
+#else
+uint8_t msg_rx_class_valid( uint8_t addr __attribute__((unused)) ) {
+  return 1;
+}
+#endif
+
 static uint8_t get_header( uint8_t flags ) __attribute__((unused));
 static uint8_t get_header( uint8_t flags ) {
   uint8_t i;
@@ -221,18 +598,23 @@ static uint8_t msg_print_rssi( char *str, uint8_t rssi, uint8_t valid ) {
   uint8_t n = 0;
 
   if( valid ) {
-    n = sprintf_P(str, PSTR("%03u "), rssi );
+    n = fmt_dec3( str, rssi );
+    str[n++] = ' ';
   } else {
-    n = sprintf_P(str, PSTR("--- "));
+    n = fmt_str_P( str, PSTR("--- ") );
   }
 
   return n;
 }
 
 static uint8_t msg_print_type( char *str, uint8_t type ) {
+  char const *t = MsgType[type];
   uint8_t n = 0;
 
- n = sprintf_P( str,PSTR("%2s "),MsgType[type] );
+  // Right aligned in two characters
+  str[n++] = t[1] ? t[0] : ' ';
+  str[n++] = t[1] ? t[1] : t[0];
+  str[n++] = ' ';
 
   return n;
 }
@@ -246,9 +628,12 @@ static uint8_t msg_print_addr( char *str, uint8_t *addr, uint8_t valid ) {
                  | (uint32_t)( addr[1]        ) <<  8
                  | (uint32_t)( addr[2]        )       ;
 
-    n = sprintf_P(str, PSTR("%02hu:%06lu "), class, dev );
+    n  = fmt_dec( str, class, 2 );
+    str[n++] = ':';
+    n += fmt_dec( str+n, dev, 6 );
+    str[n++] = ' ';
   } else {
-    n = sprintf_P(str, PSTR("--:------ "));
+    n = fmt_str_P( str, PSTR("--:------ ") );
   }
 
   return n;
@@ -258,9 +643,10 @@ static uint8_t msg_print_param( char *str, uint8_t param, uint8_t valid ) {
   uint8_t n = 0;
 
   if( valid ) {
-    n = sprintf_P(str, PSTR("%03u "), param );
+    n = fmt_dec3( str, param );
+    str[n++] = ' ';
   } else {
-    n = sprintf_P(str, PSTR("--- "));
+    n = fmt_str_P( str, PSTR("--- ") );
   }
 
   return n;
@@ -270,9 +656,11 @@ static uint8_t msg_print_opcode( char *str, uint8_t *opcode, uint8_t valid ) {
   uint8_t n = 0;
 
   if( valid ) {
-    n = sprintf_P( str, PSTR("%02X%02X "), opcode[0],opcode[1] );
+    n  = fmt_hex( str, opcode[0] );
+    n += fmt_hex( str+n, opcode[1] );
+    str[n++] = ' ';
   } else {
-    n= sprintf_P(str, PSTR("???? "));
+    n = fmt_str_P( str, PSTR("???? ") );
   }
 
   return n;
@@ -282,20 +670,17 @@ static uint8_t msg_print_len( char *str, uint8_t len, uint8_t valid ) {
   uint8_t n = 0;
 
   if( valid ) {
-    n = sprintf_P(str, PSTR("%03u "), len );
+    n = fmt_dec3( str, len );
+    str[n++] = ' ';
   } else {
-    n = sprintf_P(str, PSTR("??? "));
+    n = fmt_str_P( str, PSTR("??? ") );
   }
 
   return n;
 }
 
 static uint8_t msg_print_payload( char *str, uint8_t payload ) {
-  uint8_t n=0;
-
-  n = sprintf_P( str,PSTR("%02X"),payload );
-
-  return n;
+  return fmt_hex( str, payload );
 }
 
 
@@ -309,14 +694,14 @@ static uint8_t msg_print_error( char *str, uint8_t error ) {
   static char const *const msg_err[MSG_ERR_MAX+1] PROGMEM = { msg_err_OK _MSG_ERR_LIST, msg_err_UNKNOWN };
 #undef _MSG_ERR
 
-  uint8_t n;
+  uint8_t n = 0;
 
   if( error ) {
     if( error>MSG_ERR_MAX ) error = MSG_ERR_MAX;
-    n = sprintf_P( str, PSTR(" * %S\r\n"), (PGM_P)pgm_read_word( msg_err + error ) );
-  } else {
-    n = sprintf_P(str,PSTR("\r\n"));
+    n  = fmt_str_P( str, PSTR(" * ") );
+    n += fmt_str_P( str+n, (PGM_P)pgm_read_word( msg_err + error ) );
   }
+  n += fmt_str_P( str+n, PSTR("\r\n") );
 
   return n;
 }
@@ -324,10 +709,10 @@ static uint8_t msg_print_error( char *str, uint8_t error ) {
 static uint8_t msg_print_raw( char *str, uint8_t raw, uint8_t i ) {
   uint8_t n = 0;
 
-  if( i )
-    n = sprintf_P( str,PSTR("%02X."),raw );
-  else
-    n = sprintf_P( str,PSTR("# %02X."),raw );
+  if( !i )
+    n = fmt_str_P( str, PSTR("# ") );
+  n += fmt_hex( str+n, raw );
+  str[n++] = '.';
 
   return n;
 }
@@ -337,84 +722,110 @@ static uint8_t msg_print_raw( char *str, uint8_t raw, uint8_t i ) {
 ** msg_print_field
 **
 ** get the next buffer of output text
+**
+** A live message is still being received. Its fields are printed as soon
+** as they arrive and nothing is returned while the next one is awaited.
 **/
 
+static struct msg_cursor {
+  uint8_t state;
+  uint8_t count;
+  uint8_t live;
+  uint8_t bin;
+  uint8_t n;    // Bytes of the buffer still to send
+  uint8_t out;  // Bytes of it already sent
+  uint16_t fcs;
+} prt;
+
+#define PRT_WAIT(_ready) if( prt.live && !(_ready) ) break
+
 static uint8_t msg_print_field( struct message *msg, char *buff ) {
   uint8_t nBytes = 0;
 
-  switch( msg->state ) {
+  switch( prt.state ) {
   case S_START:
-    nBytes = msg_print_rssi( buff, msg->rssi, msg->rxFields&F_RSSI );
-    msg->state = S_HEADER;
+    if( prt.live ) // Signal strength while the frame is arriving
+      nBytes = msg_print_rssi( buff, cc_read_rssi(), 1 );
+    else
+      nBytes = msg_print_rssi( buff, msg->rssi, msg->rxFields&F_RSSI );
+    prt.state = S_HEADER;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_HEADER:
+    PRT_WAIT( msg->state > S_HEADER );
     nBytes = msg_print_type( buff, msg->fields & F_MASK );
-    msg->state = S_PARAM0;
+    prt.state = S_PARAM0;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_PARAM0:
+    PRT_WAIT( !( msg->fields & F_PARAM0 ) || ( msg->rxFields & F_PARAM0 ) );
     nBytes = msg_print_param( buff, msg->param[0], msg->rxFields&F_PARAM0 );
-    msg->state = S_ADDR0;
+    prt.state = S_ADDR0;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_ADDR0:
+    PRT_WAIT( !( msg->fields & F_ADDR0 ) || ( msg->rxFields & F_ADDR0 ) );
     nBytes = msg_print_addr( buff, msg->addr[0], msg->rxFields&F_ADDR0 );
-    msg->state = S_ADDR1;
+    prt.state = S_ADDR1;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_ADDR1:
+    PRT_WAIT( !( msg->fields & F_ADDR1 ) || ( msg->rxFields & F_ADDR1 ) );
     nBytes = msg_print_addr( buff, msg->addr[1], msg->rxFields&F_ADDR1 );
-    msg->state = S_ADDR2;
+    prt.state = S_ADDR2;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_ADDR2:
+    PRT_WAIT( !( msg->fields & F_ADDR2 ) || ( msg->rxFields & F_ADDR2 ) );
     nBytes = msg_print_addr( buff, msg->addr[2], msg->rxFields&F_ADDR2 );
-    msg->state = S_OPCODE;
+    prt.state = S_OPCODE;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_OPCODE:
+    PRT_WAIT( msg->rxFields & F_OPCODE );
     nBytes = msg_print_opcode( buff, msg->opcode, msg->rxFields&F_OPCODE );
-    msg->state = S_LEN;
+    prt.state = S_LEN;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_LEN:
+    PRT_WAIT( msg->rxFields & F_LEN );
     nBytes = msg_print_len( buff, msg->len, msg->rxFields&F_LEN );
-    msg->state = S_PAYLOAD;
+    prt.state = S_PAYLOAD;
     if( nBytes )
       break;
     /* fallthrough */
 
   case S_PAYLOAD:
     // Multi buffer field
-    if( msg->count < msg->nPayload ) {
-      nBytes = msg_print_payload( buff, msg->payload[msg->count++] );
+    if( prt.count < msg->nPayload ) {
+      nBytes = msg_print_payload( buff, msg->payload[prt.count++] );
       if( nBytes )
         break;
     }
+    PRT_WAIT( 0 );
 
-    msg->count = 0;
-    msg->state = S_ERROR;
+    prt.count = 0;
+    prt.state = S_ERROR;
     /* fallthrough */
 
   case S_ERROR:
     // This always includes "\r\n"
     nBytes = msg_print_error( buff, msg->error );
-    msg->state = S_TRAILER;
+    prt.state = S_TRAILER;
     if( nBytes )
       break;
     /* fallthrough */
@@ -422,21 +833,184 @@ static uint8_t msg_print_field( struct message *msg, char *buff ) {
   case S_TRAILER:   // Don't print trailer, use state for raw data
     // Multi buffer field
     if( msg->error || TRACE(TRC_RAW) ){
-      if( msg->count < msg->nBytes ) {
-        nBytes = msg_print_raw( buff, msg->raw[msg->count], msg->count );
-        msg->count++;
+      if( prt.count < msg->nBytes ) {
+        nBytes = msg_print_raw( buff, msg->raw[prt.count], prt.count );
+        prt.count++;
       } else if( msg->nBytes ) {
-        nBytes = sprintf_P( buff, PSTR("\r\n") );
-        msg->state = S_COMPLETE;
+        nBytes = fmt_str_P( buff, PSTR("\r\n") );
+        prt.state = S_COMPLETE;
       }
       if( nBytes )
         break;
     }
 
-    msg->count = 0;
-    msg->state = S_COMPLETE;
+    prt.count = 0;
+    prt.state = S_COMPLETE;
+    /* fallthrough */
+
+  case S_COMPLETE:
+    break;
+  }
+
+  return nBytes;
+}
+
+/********************************************************
+** Binary host protocol
+**
+** An alternative to the text lines, selected with !B1.
+** Each message is a frame of binary fields delimited by
+** FLAG bytes. FLAG, ESC and the bytes the tty can't carry
+** are sent as ESC followed by the byte XOR 0x20. A frame
+** ends with the PPP FCS-16 of its unescaped bytes.
+** The layout of each frame type is given in README.md.
+********************************************************/
+#define BIN_FLAG 0x7E
+#define BIN_ESC  0x7D
+#define BIN_XOR  0x20
+
+#define BIN_RX     0x01
+#define BIN_TX     0x02
+#define BIN_CMD    0x03
+#define BIN_PACKET 0x04
+#define BIN_CODED  0x05
+#define BIN_AT     0x06
+
+#define FCS_INIT 0xFFFF
+#define FCS_GOOD 0xF0B8
+
+static uint8_t msgBinary;
+
+void msg_binary( uint8_t on ) {
+  msgBinary = on;
+}
+
+uint8_t msg_binary_mode(void) {
+  return msgBinary;
+}
+
+static uint8_t bin_escaped( uint8_t byte ) {
+  return byte==BIN_FLAG || byte==BIN_ESC
+      || byte==0x00                       // tty_rx_get() returns it for no data
+      || byte==( 'Q' & 0x3F ) || byte==( 'S' & 0x3F );  // XON/XOFF flow control
+}
+
+static uint8_t bin_put( char *str, uint8_t const *bytes, uint8_t n, uint16_t *fcs ) {
+  uint8_t nChar = 0;
+
+  while( n-- ) {
+    uint8_t byte = *(bytes++);
+    (*fcs) = _crc_ccitt_update( *fcs, byte );
+    if( bin_escaped( byte ) ) {
+      str[nChar++] = BIN_ESC;
+      byte ^= BIN_XOR;
+    }
+    str[nChar++] = byte;
+  }
+
+  return nChar;
+}
+
+static uint8_t bin_put_fcs( char *str, uint16_t *fcs ) {
+  uint8_t bytes[2];
+  uint8_t nChar;
+
+  (*fcs) ^= 0xFFFF;
+  bytes[0] = (*fcs) & 0xFF;
+  bytes[1] = (*fcs) >> 8;
+  nChar = bin_put( str, bytes, 2, fcs );
+  str[nChar++] = BIN_FLAG;
+
+  return nChar;
+}
+
+/************************************************************************************
+**
+** msg_pack_field
+**
+** get the next buffer of a binary RX frame
+**
+** Fields follow the order they have on air. Those named in the header are
+** always sent, zero if they were not received. Live messages wait for
+** each field as msg_print_field() does.
+**/
+
+#define BIN_PAYLOAD_CHUNK 8
+
+static uint8_t msg_pack_field( struct message *msg, char *buff ) {
+  uint8_t nBytes = 0;
+  uint8_t bytes[2];
+
+  switch( prt.state ) {
+  case S_START:
+    buff[nBytes++] = BIN_FLAG;
+    prt.fcs = FCS_INIT;
+    bytes[0] = BIN_RX;
+    bytes[1] = prt.live ? cc_read_rssi() : msg->rssi;
+    nBytes += bin_put( buff+nBytes, bytes, 2, &prt.fcs );
+    prt.state = S_HEADER;
+    break;
+
+  case S_HEADER:
+    PRT_WAIT( msg->state > S_HEADER );
+    bytes[0] = msg->fields & ( F_MASK | F_OPTION );
+    nBytes = bin_put( buff, bytes, 1, &prt.fcs );
+    prt.state = S_ADDR0;
+    break;
+
+  case S_ADDR0:
+  case S_ADDR1:
+  case S_ADDR2:
+  case S_PARAM0:
+  case S_PARAM1:
+    while( prt.state <= S_PARAM1 && !nBytes ) {
+      uint8_t field = ( prt.state < S_PARAM0 ) ? F_ADDR0 << ( prt.state - S_ADDR0 )
+                                                : F_PARAM0 << ( prt.state - S_PARAM0 );
+      if( msg->fields & field ) {
+        PRT_WAIT( msg->rxFields & field );
+        if( prt.state < S_PARAM0 )
+          nBytes = bin_put( buff, msg->addr[ prt.state - S_ADDR0 ], 3, &prt.fcs );
+        else
+          nBytes = bin_put( buff, msg->param + ( prt.state - S_PARAM0 ), 1, &prt.fcs );
+      }
+      prt.state++;
+    }
+    break;
+
+  case S_OPCODE:
+    PRT_WAIT( msg->rxFields & F_OPCODE );
+    nBytes = bin_put( buff, msg->opcode, 2, &prt.fcs );
+    prt.state = S_LEN;
+    break;
+
+  case S_LEN:
+    PRT_WAIT( msg->rxFields & F_LEN );
+    nBytes = bin_put( buff, &msg->len, 1, &prt.fcs );
+    prt.state = S_PAYLOAD;
+    break;
+
+  case S_PAYLOAD:
+    if( prt.count < msg->nPayload ) {
+      uint8_t n = msg->nPayload - prt.count;
+      if( n > BIN_PAYLOAD_CHUNK ) n = BIN_PAYLOAD_CHUNK;
+      nBytes = bin_put( buff, msg->payload + prt.count, n, &prt.fcs );
+      prt.count += n;
+      break;
+    }
+    PRT_WAIT( 0 );
+
+    prt.count = 0;
+    prt.state = S_ERROR;
     /* fallthrough */
 
+  case S_ERROR:
+    bytes[0] = msg->error;
+    bytes[1] = msg->rxFields;
+    nBytes = bin_put( buff, bytes, 2, &prt.fcs );
+    nBytes += bin_put_fcs( buff+nBytes, &prt.fcs );
+    prt.state = S_COMPLETE;
+    break;
+
   case S_COMPLETE:
     break;
   }
@@ -451,38 +1025,42 @@ static uint8_t msg_print_field( struct message *msg, char *buff ) {
 ** Called repeatedly from msg_work.
 ** Neither this function or any it calls must block or delay
 **
-** Acquires a buffer of output and tries to send it to the serial port
-** If it's not transferred this time, try again until it goes.
+** Acquires a buffer of output and sends as much of it as the serial port
+** will take. The rest goes next time.
 **
-** Keep getting more buffers until we get a zero length buffer
-**
-** We can re-use some of the working fields from struct message to control
-** progress
+** Keep getting more buffers until the message is complete
 **/
 
+static void msg_print_start( uint8_t live ) {
+  DEBUG_MSG(1);
+  memset( &prt, 0, sizeof(prt) );
+  prt.state = S_START;
+  prt.live = live;
+  prt.bin = msgBinary;
+}
+
 static uint8_t msg_print( struct message *msg ) {
   static char msg_buff[TXBUF];
-  static uint8_t n;
-
-  if( msg->state == S_START ) {
-    DEBUG_MSG(1);
-    msg->count = 0;
-    n = 0;
-  }
 
   // Do we still have outstanding text to send?
-  if( n ) {
-    n -= tty_put_str( (uint8_t *)msg_buff, n );
+  if( prt.n ) {
+    uint8_t n = tty_put_str( (uint8_t *)msg_buff + prt.out, prt.n );
+    prt.out += n;
+    prt.n -= n;
   }
 
-  if( !n ) {
-    n = msg_print_field( msg, msg_buff );
+  if( !prt.n ) {
+    prt.out = 0;
+    prt.n = prt.bin ? msg_pack_field( msg, msg_buff )
+                    : msg_print_field( msg, msg_buff );
   }
 
-  if( msg->state == S_COMPLETE )
+  if( prt.state == S_COMPLETE && !prt.n ) {
     DEBUG_MSG(0);
+    return 0;
+  }
 
-  return n;
+  return 1;
 }
 
 /********************************************************
@@ -567,38 +1145,84 @@ static uint8_t msg_rx_checksum( struct message *msg, uint8_t byte __attribute__(
   return state;
 }
 
-static struct message *msgRx;
-static void msg_rx_process(uint8_t byte) {
-  msgRx->csum += byte;
-  switch( msgRx->state ) {
+/********************************************************
+** RX work message
+**
+** The only message state shared with an ISR. Ownership
+** passes between them with the frame state instead of
+** a lock:
+**  - msg_rx_start() and msg_rx_byte() run in the edge
+**    analysis ISR. It owns the message from the frame
+**    header until frame_rx_byte() ends the frame.
+**  - frame_work() then owns it. frame_rx_done() calls
+**    msg_rx_rssi() and msg_rx_end(), which copies it into
+**    the arena.
+**  - RX is not re-enabled until that has returned, so no
+**    new frame can start in it before then.
+** The arena and the TX messages are only used from the
+** main loop. host/test/msg_stress.c checks this split
+** with the ISR fired between every arena operation.
+********************************************************/
+static uint8_t rxPayload[MAX_PAYLOAD];
+static uint8_t rxRaw[MAX_RAW];
+static struct message rxMsg = { .payload=rxPayload, .raw=rxRaw };
+static struct message *msgRx = &rxMsg;
+static volatile uint8_t rxLive;     // Between msg_rx_start() and msg_rx_end()
+
+// Message being printed
+static struct message *rxPrint;
+
+// With TRC_CUT set a message is printed while it's being received
+// Its record is reserved at full size before printing starts
+static struct msg_rec *rxLiveRec;
+
+static void msg_rx_process( struct message *msg, uint8_t byte ) {
+  msg->csum += byte;
+  switch( msg->state ) {
     case S_START: // not processed here - fallthrough
-    case S_HEADER:                                   { msgRx->state = msg_rx_header( msgRx, byte );   break; }
-    case S_ADDR0:     if( msgRx->fields & F_ADDR0 )  { msgRx->state = msg_rx_addr( msgRx, 0, byte );  break; } /* fallthrough */
-    case S_ADDR1:     if( msgRx->fields & F_ADDR1 )  { msgRx->state = msg_rx_addr( msgRx, 1, byte );  break; } /* fallthrough */
-    case S_ADDR2:     if( msgRx->fields & F_ADDR2 )  { msgRx->state = msg_rx_addr( msgRx, 2, byte );  break; } /* fallthrough */
-    case S_PARAM0:    if( msgRx->fields & F_PARAM0 ) { msgRx->state = msg_rx_param( msgRx, 0, byte ); break; } /* fallthrough */
-    case S_PARAM1:    if( msgRx->fields & F_PARAM1 ) { msgRx->state = msg_rx_param( msgRx, 1, byte ); break; } /* fallthrough */
-    case S_OPCODE:                                   { msgRx->state = msg_rx_opcode( msgRx, byte );   break; }
-    case S_LEN:                                      { msgRx->state = msg_rx_len( msgRx, byte );      break; }
-    case S_PAYLOAD:                                  { msgRx->state = msg_rx_payload( msgRx, byte );  break; }
-    case S_CHECKSUM:                                 { msgRx->state = msg_rx_checksum( msgRx, byte ); break; }
+    case S_HEADER:                                 { msg->state = msg_rx_header( msg, byte );   break; }
+    case S_ADDR0:     if( msg->fields & F_ADDR0 )  { msg->state = msg_rx_addr( msg, 0, byte );  break; } /* fallthrough */
+    case S_ADDR1:     if( msg->fields & F_ADDR1 )  { msg->state = msg_rx_addr( msg, 1, byte );  break; } /* fallthrough */
+    case S_ADDR2:     if( msg->fields & F_ADDR2 )  { msg->state = msg_rx_addr( msg, 2, byte );  break; } /* fallthrough */
+    case S_PARAM0:    if( msg->fields & F_PARAM0 ) { msg->state = msg_rx_param( msg, 0, byte ); break; } /* fallthrough */
+    case S_PARAM1:    if( msg->fields & F_PARAM1 ) { msg->state = msg_rx_param( msg, 1, byte ); break; } /* fallthrough */
+    case S_OPCODE:                                 { msg->state = msg_rx_opcode( msg, byte );   break; }
+    case S_LEN:                                    { msg->state = msg_rx_len( msg, byte );      break; }
+    case S_PAYLOAD:                                { msg->state = msg_rx_payload( msg, byte );  break; }
+    case S_CHECKSUM:                               { msg->state = msg_rx_checksum( msg, byte ); break; }
   }
 }
 
+// All optional fields received as expected?
+static uint8_t msg_rx_check( struct message *msg, uint8_t error ) {
+  if( error==MSG_OK ) {
+    if(   ( ( msg->rxFields & F_OPTION ) != ( msg->fields & F_OPTION ) )
+       || ( ( msg->rxFields & F_MAND   ) != F_MAND  )
+       || ( msg->len != msg->nPayload ) ) {
+       error = MSG_TRUNC_ERR;
+    }
+  }
+
+  return error;
+}
+
 void msg_rx_rssi( uint8_t rssi ) {
   msgRx->rssi = rssi;
   msgRx->rxFields |= F_RSSI;
 }
 
+void msg_rx_time( uint32_t ms ) {
+  rxTime = ms;
+}
+
 uint8_t *msg_rx_start(void) {
   uint8_t *raw = NULL;
   DEBUG_MSG(1);
 
-  msgRx = msg_alloc();
-  if( msgRx ) {
-    raw = msgRx->raw;
-    raw[0] = MAX_RAW;
-  }
+  msg_reset( msgRx );
+  raw = msgRx->raw;
+  raw[0] = MAX_RAW;
+  rxLive = 1;
 
   DEBUG_MSG(0);
 
@@ -608,7 +1232,7 @@ uint8_t *msg_rx_start(void) {
 uint8_t msg_rx_byte( uint8_t byte ) {
   DEBUG_MSG(1);
 
-  msg_rx_process( byte );
+  msg_rx_process( msgRx, byte );
 
   DEBUG_MSG(0);
 
@@ -619,40 +1243,106 @@ void msg_rx_end( uint8_t nBytes, uint8_t error ) {
   DEBUG_MSG(1);
 
   msgRx->nBytes = nBytes;
-
-  if( error==MSG_OK ) {
-    // All optional fields received as expected?
-    if(   ( ( msgRx->rxFields & F_OPTION ) != ( msgRx->fields & F_OPTION ) )
-       || ( ( msgRx->rxFields & F_MAND   ) != F_MAND  )
-       || ( msgRx->len != msgRx->nPayload ) ) {
-       error = MSG_TRUNC_ERR;
-    }
+  msgRx->error = msg_rx_check( msgRx, error );
+  msg_at_source( msgRx );
+  if( rxLiveRec ) { // Finish printing it from the arena
+    msg_fill( rxLiveRec, msgRx );
+    rxPrint = &rxLiveRec->msg;
+    rxLiveRec = NULL;
+    prt.live = 0;
+  } else {
+    msg_rx_ready( msgRx );  // Dropped if the arena is full
   }
-
-  msgRx->error = error;
-  msg_rx_ready( &msgRx );
+  rxLive = 0;
 
   DEBUG_MSG(0);
 }
 
+/********************************************************
+** TX raw frames
+**
+** The host can send a frame it has built itself instead
+** of its fields. The bytes are kept as the payload of the
+** message and sent without being checked, as packet bytes
+** to be Manchester coded or as bytes already coded.
+** The echo is decoded from what was sent.
+********************************************************/
+#define TX_RAW_BUF ( MAX_RAW+2 )  // A coded frame and the FCS of a binary one
+
+static uint8_t msg_raw_byte( struct message *msg, uint8_t byte ) {
+  uint8_t ok = ( msg->nPayload < TX_RAW_BUF );
+
+  if( ok )
+    msg->payload[ msg->nPayload++ ] = byte;
+
+  return ok;
+}
+
+// The frame must fit in its record once it's coded
+static uint8_t msg_raw_end( struct message *msg ) {
+  uint8_t max = ( msg->format==TX_CODED ) ? MAX_RAW : MAX_RAW/2;
+  uint8_t ok = ( msg->nPayload > 0 && msg->nPayload <= max );
+
+  if( ok )
+    msg->state = S_COMPLETE;
+
+  return ok;
+}
+
 /********************************************************
 ** TX Message scan
+**
+** Host text is parsed a character at a time. Each field
+** is checked and its value built up as it arrives, then
+** stored in the message when the space or CR after it
+** ends the field. Payload bytes are stored as soon as
+** both of their digits have arrived.
+**
+** A line starting with '=' is the hex bytes of a packet
+** and one starting with '~' the hex bytes of a coded one.
+** Spaces are allowed between the bytes.
+**
+** Any of them can be preceded by a schedule field, '@'
+** and a delay in ms or '@CC:IIIIII+' and a delay from the
+** last frame received from that address.
 ********************************************************/
 static uint8_t  MyClass = 18;
 static uint32_t MyID = 0x4DADA;
 
-static uint8_t msg_scan_header( struct message *msg, char *str, uint8_t nChar ) {
+#define SCAN_FIELD_MAX 16
+
+static struct msg_scanner {
+  uint32_t value;  // Number being built
+  uint8_t nChar;   // Characters of the field so far
+  uint8_t nDigit;  // Digits of the number so far
+  uint8_t skip;    // Field is a '-' placeholder
+  uint8_t colon;   // Address class has been seen
+  uint8_t class;
+  char type[2];
+} scan;
+
+static int8_t scan_digit( uint8_t c, uint8_t hex ) {
+  if( c>='0' && c<='9' )
+    return c - '0';
+
+  if( hex ) {
+    c |= ( 'A'^'a' );  // Lower case
+    if( c>='a' && c<='f' )
+      return c - 'a' + 10;
+  }
+
+  return -1;
+}
+
+static uint8_t msg_scan_header( struct message *msg ) {
   uint8_t ok = 0;
   uint8_t msgType;
 
-  // Cheap conversion to upper for acceptable characters
-  while( --nChar )
-    str[ nChar-1 ] &= ~( 'A'^'a' );
-
   for( msgType=F_RQ ; msgType<=F_RP ; msgType++ ) {
-    if( 0==strcmp( str, MsgType[msgType] ) ) {
+    char const *t = MsgType[msgType];
+    if( scan.type[0]==t[0] && ( ( scan.nChar==2 ) ? scan.type[1]==t[1] : t[1]=='\0' ) ) {
       msg->fields = msgType;
-	  ok = 1;
+      ok = 1;
       break;
     }
   }
@@ -660,19 +1350,19 @@ static uint8_t msg_scan_header( struct message *msg, char *str, uint8_t nChar )
   return ok;
 }
 
-static uint8_t msg_scan_addr( struct message *msg, char *str, uint8_t nChar ) {
-  uint8_t ok = 0;
+static uint8_t msg_scan_addr( struct message *msg ) {
+  uint8_t ok = 1;
   uint8_t addr = msg->state - S_ADDR0;
 
-  if( str[0]!='-' ) {
-    uint8_t class;
-    uint32_t id;
-
-  	if( nChar<11 && 2==sscanf( str, "%hhu:%lu", &class, &id ) ) {
+  if( !scan.skip ) {
+    uint8_t class = scan.class;
+    uint32_t id = scan.value;
 
-	  // Specific address for this device
+    ok = ( scan.colon && scan.nDigit && scan.nChar<11 && id<=0x3FFFF );
+    if( ok ) {
+      // Specific address for this device
       if( class==18 && id==730 ) {
-        class = MyClass;		  
+        class = MyClass;
         id = MyID;
       }
 
@@ -681,41 +1371,38 @@ static uint8_t msg_scan_addr( struct message *msg, char *str, uint8_t nChar ) {
       msg->addr[addr][2] =                 ( ( id       ) & 0xFF );
 
       msg->fields |= F_ADDR0 << addr;
-      ok = 1;
 
       msg->csum += msg->addr[addr][0] + msg->addr[addr][1] + msg->addr[addr][2];
-    } 
-  } else {
-    ok = 1;
+    }
   }
 
   return ok;
 }
 
-static uint8_t msg_scan_param( struct message *msg, char *str, uint8_t nChar ) {
-  uint8_t ok = 0;
+static uint8_t msg_scan_param( struct message *msg ) {
+  uint8_t ok = 1;
   uint8_t param = msg->state - S_PARAM0;
 
-  if( str[0]!='-' ) {
-  	if( nChar<5 && 1==sscanf( str, "%hhu", msg->param+param ) ) {
+  if( !scan.skip ) {
+    ok = ( scan.nDigit<4 && scan.value<=255 );
+    if( ok ) {
+      msg->param[param] = scan.value;
       msg->fields |= F_PARAM0 << param;
-      ok = 1;
 
       msg->csum += msg->param[param];
-    } 
-  } else {
-    ok = 1;
+    }
   }
 
   return ok;
 }
 
-static uint8_t msg_scan_opcode( struct message *msg, char *str, uint8_t nChar ) {
-  uint8_t ok = 0;
+static uint8_t msg_scan_opcode( struct message *msg ) {
+  uint8_t ok = ( scan.nDigit==4 );
 
-  if( nChar==5 && 2==sscanf( str, "%02hhx%02hhx", msg->opcode+0,msg->opcode+1 )  ) {
+  if( ok ) {
+    msg->opcode[0] = scan.value >> 8;
+    msg->opcode[1] = scan.value;
     msg->rxFields |= F_OPCODE;
-    ok = 1;
 
     msg->csum += msg->opcode[0] + msg->opcode[1];
   }
@@ -723,54 +1410,205 @@ static uint8_t msg_scan_opcode( struct message *msg, char *str, uint8_t nChar )
   return ok;
 }
 
-static uint8_t msg_scan_len( struct message *msg, char *str, uint8_t nChar ) {
-  uint8_t ok = 0;
+static uint8_t msg_scan_len( struct message *msg ) {
+  uint8_t ok = ( scan.nDigit<4 && scan.value > 0 && scan.value <= MAX_PAYLOAD );
 
-  if( nChar<5 && 1==sscanf( str, "%hhu", &msg->len ) ) {
-    if( msg->len > 0 && msg->len <= MAX_PAYLOAD )
-    {
-      msg->rxFields |= F_LEN;
-      ok = 1;
+  if( ok ) {
+    msg->len = scan.value;
+    msg->rxFields |= F_LEN;
+
+    msg->csum += msg->len;
+
+    ok = ( ( msg->rxFields & F_MAND ) == F_MAND );
+  }
+
+  return ok;
+}
+
+// A character of a field, digits are added to the number being built
+static uint8_t msg_scan_char( struct message *msg, uint8_t c ) {
+  uint8_t ok = 1;
+  int8_t d;
+
+  if( scan.nChar==0 ) {
+    scan.value = 0;
+    scan.nDigit = 0;
+    scan.colon = 0;
+    scan.skip = ( c=='-' );
+  }
+  if( ++scan.nChar > SCAN_FIELD_MAX )
+    return 0;
+
+  switch( msg->state ) {
+  case S_START:
+    if( scan.nChar==1 && ( c=='=' || c=='~' ) ) {
+      msg->format = ( c=='=' ) ? TX_PACKET : TX_CODED;
+      msg->state = S_RAW;
+      scan.nChar = 0;
+      break;
+    }
+    if( scan.nChar==1 && c=='@' ) {
+      ok = ( txAt.ref==AT_NONE );
+      msg->state = S_AT;
+      scan.nChar = 0;
+      break;
+    }
+    /* fallthrough */
+  case S_HEADER:
+    ok = ( scan.nChar<=2 );
+    if( ok )
+      scan.type[ scan.nChar-1 ] = c & ~( 'A'^'a' );  // Cheap conversion to upper
+    break;
 
-      msg->csum += msg->len;
+  case S_ADDR0:
+  case S_ADDR1:
+  case S_ADDR2:
+    if( !scan.skip && c==':' ) {
+      ok = ( !scan.colon && scan.nDigit && scan.value<64 );
+      scan.class = scan.value;
+      scan.colon = 1;
+      scan.value = 0;
+      scan.nDigit = 0;
+      break;
+    }
+    /* fallthrough */
+  case S_PARAM0:
+    if( scan.skip )
+      break;
+    /* fallthrough */
+  case S_LEN:
+    d = scan_digit( c, 0 );
+    ok = ( d>=0 && scan.nDigit<9 );
+    scan.value = scan.value*10 + d;
+    scan.nDigit++;
+    break;
+
+  case S_OPCODE:
+    d = scan_digit( c, 1 );
+    ok = ( d>=0 && scan.nDigit<4 );
+    scan.value = ( scan.value<<4 ) | d;
+    scan.nDigit++;
+    break;
+
+  case S_PAYLOAD:  // No spaces between PAYLOAD bytes
+    d = scan_digit( c, 1 );
+    ok = ( d>=0 );
+    scan.value = ( scan.value<<4 ) | d;
+    if( ++scan.nDigit==2 ) {
+      msg->payload[ msg->nPayload++ ] = scan.value;
+      msg->csum += scan.value;
+      if( msg->nPayload == msg->len )
+        msg->state = S_CHECKSUM;
+      scan.nChar = 0;
+    }
+    break;
+
+  case S_RAW:
+    d = scan_digit( c, 1 );
+    ok = ( d>=0 );
+    scan.value = ( scan.value<<4 ) | d;
+    if( ok && ++scan.nDigit==2 ) {
+      ok = msg_raw_byte( msg, scan.value );
+      scan.nChar = 0;
+    }
+    break;
+
+  case S_AT:  // [CC:IIIIII+]ms
+    if( c==':' ) {
+      ok = ( !scan.colon && scan.nDigit && scan.value<64 );
+      scan.class = scan.value;
+      scan.colon = 1;
+    } else if( c=='+' ) {
+      ok = ( scan.colon && scan.nDigit && txAt.ref==AT_NONE && scan.value<=0x3FFFF );
+      txAt.addr[0] = ( scan.class<< 2 ) | ( ( scan.value >> 16 ) & 0x03 );
+      txAt.addr[1] =                      ( ( scan.value >>  8 ) & 0xFF );
+      txAt.addr[2] =                      ( ( scan.value       ) & 0xFF );
+      txAt.ref = AT_ADDR;
+    } else {
+      d = scan_digit( c, 0 );
+      ok = ( d>=0 && scan.nDigit<9 );
+      scan.value = scan.value*10 + d;
+      scan.nDigit++;
+      break;
     }
-  } 
+    scan.value = 0;
+    scan.nDigit = 0;
+    break;
+
+  default:  // Nothing else on the line
+    ok = 0;
+    break;
+  }
 
   return ok;
 }
 
-static uint8_t msg_scan_payload( struct message *msg, char *str, uint8_t nChar ) {
-  uint8_t ok=0;
-  
-  if( nChar==3 && 1==sscanf( str, "%02hhx", msg->payload+msg->nPayload ) )
-  {
-    msg->csum += msg->payload[msg->nPayload++];
-	ok = 1;
+static uint8_t msg_scan_at(void) {
+  uint8_t ok = ( scan.nDigit && scan.value<=0xFFFF && scan.colon==( txAt.ref==AT_ADDR ) );
+
+  if( ok ) {
+    txAt.delay = scan.value;
+    if( txAt.ref==AT_NONE )
+      txAt.ref = AT_NOW;
   }
 
   return ok;
 }
 
+// The space or CR after a field
+static uint8_t msg_scan_end( struct message *msg ) {
+  uint8_t ok = 0;
+
+  switch( msg->state ) {
+  case S_START: /* fall through */
+  case S_HEADER:      ok=msg_scan_header( msg );  msg->state = S_PARAM0;   break;
+  case S_ADDR0:       ok=msg_scan_addr( msg );    msg->state = S_ADDR1;    break;
+  case S_ADDR1:       ok=msg_scan_addr( msg );    msg->state = S_ADDR2;    break;
+  case S_ADDR2:       ok=msg_scan_addr( msg );    msg->state = S_OPCODE;   break;
+  case S_PARAM0:      ok=msg_scan_param( msg );   msg->state = S_ADDR0;    break;
+  case S_OPCODE:      ok=msg_scan_opcode( msg );  msg->state = S_LEN;      break;
+  case S_LEN:         ok=msg_scan_len( msg );     msg->state = S_PAYLOAD;  break;
+  case S_AT:          ok=msg_scan_at();           msg->state = S_START;    break;
+//  case S_PAYLOAD:   Half a byte
+//  case S_CHECKSUM:  More than the payload
+//  case S_RAW:       Half a byte
+  }
+  scan.nChar = 0;
+
+  return ok;
+}
+
 static uint8_t msg_scan( struct message *msg, uint8_t byte) {
-  static char field[17];
-  static uint8_t nChar=0;
   uint8_t ok = 1;
 
   if( byte=='\n' ) return 0; // Discard newline
 
   if( byte=='\r' ) {
     // Ignore blank line
-    if( msg->state==S_START && nChar==0 )
+    if( msg->state==S_START && scan.nChar==0 && txAt.ref==AT_NONE )
       return 0;
 
+    if( msg->state!=S_ERROR && scan.nChar )
+      ok = msg_scan_end( msg );
+
+    if( ok && msg->state==S_RAW )
+      ok = msg_raw_end( msg );
+
     // Didn't get a sensible message
-    if( msg->state != S_CHECKSUM ) {
-      nChar = 0;
+    if( !ok || ( msg->state != S_CHECKSUM && msg->state != S_COMPLETE ) ) {
+      scan.nChar = 0;
       msg_reset( msg ); // Discard
+      memset( &txAt, 0, sizeof(txAt) );
       return 0;
-    } else {
-      byte = '\0';
     }
+
+    if( msg->format==TX_FIELDS ) {
+      msg->csum += get_header(msg->fields);
+      msg->csum = -msg->csum;
+      msg->rxFields |= msg->fields;
+      msg->state = S_COMPLETE;
+    }
+    return 1;
   }
 
   // Discard to end of line
@@ -778,69 +1616,219 @@ static uint8_t msg_scan( struct message *msg, uint8_t byte) {
     return 0;
 
   if( byte==' ' ) {
-    // Discard leading spaces
-    if( nChar==0 )
-      return 0;
+    // Spaces end a field, any more are discarded
+    if( scan.nChar )
+      ok = msg_scan_end( msg );
+  } else {
+    ok = msg_scan_char( msg, byte );
+  }
 
-    // Terminate field
-    byte = '\0';
+  if( !ok ) {
+    scan.nChar = 0;
+    msg->state = S_ERROR;
   }
-  field[ nChar++ ] = (char)byte;
 
-  // No spaces between PAYLOAD bytes
-  if( byte && msg->state == S_PAYLOAD ) {
-    if( nChar==2 ) {
-      field[nChar++] = '\0';
+  return 0;
+}
 
-      ok = msg_scan_payload( msg, field, nChar );
-      if( ok ) {
-        nChar = 0;
-        if( msg->nPayload == msg->len ) {
-          msg->state = S_CHECKSUM;
+/********************************************************
+** TX Message unpack
+**
+** Binary mode counterpart of msg_scan(). A BIN_TX frame
+** is unpacked as it arrives and only accepted if its FCS
+** is good. BIN_PACKET and BIN_CODED frames carry a raw
+** frame, their FCS is stored with it and dropped at the
+** end. A BIN_CMD frame is held until it has been checked
+** and then handed to cmd(). A BIN_AT frame is held the
+** same way and sets the schedule of the next message.
+** msg_work() stops reading while the last message waits
+** to be queued, so there is always a work message.
+********************************************************/
+#define BIN_CMDBUF 16
+
+static struct msg_unpack {
+  uint8_t esc;
+  uint8_t n;       // Unescaped bytes in the frame so far
+  uint8_t type;
+  uint8_t error;
+  uint16_t fcs;
+  uint8_t nCmd;    // Length of the last command
+  char cmd[BIN_CMDBUF+2];
+} unp;
+
+static uint8_t msg_unpack_tx( struct message *msg, uint8_t byte ) {
+  uint8_t ok = 1;
+
+  // Skip fields that are not named in the header
+  while( msg->state>=S_ADDR0 && msg->state<=S_PARAM1 ) {
+    uint8_t field = ( msg->state < S_PARAM0 ) ? F_ADDR0 << ( msg->state - S_ADDR0 )
+                                              : F_PARAM0 << ( msg->state - S_PARAM0 );
+    if( msg->fields & field )
+      break;
+    msg->state++;
+  }
+
+  switch( msg->state ) {
+  case S_START:
+    msg->fields = byte & ( F_MASK | F_OPTION );
+    ok = ( get_header( msg->fields ) != 0xFF );
+    msg->state = S_ADDR0;
+    break;
+
+  case S_ADDR0:
+  case S_ADDR1:
+  case S_ADDR2: {
+      uint8_t *addr = msg->addr[ msg->state - S_ADDR0 ];
+      addr[ msg->count++ ] = byte;
+      if( msg->count==3 ) {
+        // Specific address for this device, as 18:730 in text
+        if( addr[0]==( 18<<2 ) && addr[1]==0x02 && addr[2]==0xDA ) {
+          addr[0] = ( MyClass << 2 ) | ( ( MyID >> 16 ) & 0x03 );
+          addr[1] =                    ( ( MyID >>  8 ) & 0xFF );
+          addr[2] =                    ( ( MyID       ) & 0xFF );
         }
+        msg->csum += addr[0] + addr[1] + addr[2];
+        msg->count = 0;
+        msg->state++;
       }
+    }
+    break;
 
-    } else { // wait for second byte
-      return 0;
+  case S_PARAM0:
+  case S_PARAM1:
+    msg->param[ msg->state - S_PARAM0 ] = byte;
+    msg->csum += byte;
+    msg->state++;
+    break;
+
+  case S_OPCODE:
+    msg->opcode[ msg->count++ ] = byte;
+    msg->csum += byte;
+    if( msg->count==2 ) {
+      msg->rxFields |= F_OPCODE;
+      msg->count = 0;
+      msg->state = S_LEN;
     }
+    break;
+
+  case S_LEN:
+    ok = ( byte > 0 && byte <= MAX_PAYLOAD );
+    msg->len = byte;
+    msg->csum += byte;
+    msg->rxFields |= F_LEN;
+    msg->state = S_PAYLOAD;
+    break;
+
+  case S_PAYLOAD:
+    msg->payload[ msg->nPayload++ ] = byte;
+    msg->csum += byte;
+    if( msg->nPayload == msg->len )
+      msg->state = S_CHECKSUM;
+    break;
+
+  case S_CHECKSUM:  // The FCS
+    ok = ( msg->count++ < 2 );
+    break;
+
+  default:
+    ok = 0;
+    break;
   }
 
-  if( !byte ) {
-    switch( msg->state ) {
-    case S_START: /* fall through */
-    case S_HEADER:      ok=msg_scan_header( msg, field, nChar ); msg->state = S_PARAM0;   break;
-    case S_ADDR0:       ok=msg_scan_addr( msg, field, nChar );   msg->state = S_ADDR1;    break;
-    case S_ADDR1:       ok=msg_scan_addr( msg, field, nChar );   msg->state = S_ADDR2;    break;
-    case S_ADDR2:       ok=msg_scan_addr( msg, field, nChar );   msg->state = S_OPCODE;   break;
-    case S_PARAM0:      ok=msg_scan_param( msg, field, nChar );  msg->state = S_ADDR0;    break;
-//    case S_PARAM1:
-    case S_OPCODE:      ok=msg_scan_opcode( msg, field, nChar ); msg->state = S_LEN;      break;
-    case S_LEN:         ok=msg_scan_len( msg, field, nChar );    msg->state = S_PAYLOAD;  break;
-    case S_PAYLOAD:                                              msg->state = S_ERROR;    break;
-    case S_CHECKSUM:    msg->state = ( nChar!=1 ) ? S_ERROR : S_COMPLETE;                 break;
-//  case S_TRAILER:
-//  case S_COMPLETE:
-//  case S_ERROR:
+  return ok;
+}
+
+static uint8_t msg_unpack_end( struct message *msg ) {
+  uint8_t type = 0;
+
+  if( !unp.error && unp.fcs==FCS_GOOD ) {
+    if( unp.type==BIN_TX ) {
+      if( msg->state==S_CHECKSUM && msg->count==2 ) {
+        msg->csum += get_header( msg->fields );
+        msg->csum = -msg->csum;
+        msg->rxFields |= msg->fields;
+        msg->state = S_COMPLETE;
+        type = BIN_TX;
+      }
+    } else if( unp.type==BIN_PACKET || unp.type==BIN_CODED ) {
+      if( msg->nPayload > 2 ) {
+        msg->nPayload -= 2;  // The FCS
+        if( msg_raw_end( msg ) )
+          type = BIN_TX;
+      }
+    } else if( unp.type==BIN_CMD && unp.n > 3 ) {
+      unp.nCmd = unp.n - 3;  // Without type and FCS
+      type = BIN_CMD;
+    } else if( unp.type==BIN_AT && ( unp.n==5 || unp.n==8 ) ) {
+      txAt.ref = ( unp.n==8 ) ? AT_ADDR : AT_NOW;
+      txAt.delay = (uint8_t)unp.cmd[0] | ( (uint8_t)unp.cmd[1] << 8 );
+      memcpy( txAt.addr, unp.cmd+2, 3 );
     }
-    nChar = 0;
   }
-  
-  if( !ok )
-    msg->state = S_ERROR;
 
-  if( msg->state==S_PAYLOAD ) {
-    if( ( msg->rxFields & F_MAND ) != F_MAND ) {
-      msg->state = S_ERROR;
-    }
+  if( unp.type!=BIN_CMD && unp.type!=BIN_AT && type!=BIN_TX ) {
+    msg_reset( msg );  // Discard
+    memset( &txAt, 0, sizeof(txAt) );
   }
 
-  if( msg->state==S_COMPLETE ) {
-    msg->csum += get_header(msg->fields);
-    msg->csum = -msg->csum;
-    msg->rxFields |= msg->fields;
-    return 1;
+  return type;
+}
+
+// Returns the type of a good frame once it has ended, BIN_TX for any to be sent
+static uint8_t msg_unpack( struct message *msg, uint8_t byte ) {
+  uint8_t type = 0;
+
+  if( byte==BIN_FLAG ) {
+    if( unp.n )
+      type = msg_unpack_end( msg );
+    unp.esc = 0;
+    unp.n = 0;
+    unp.error = 0;
+    unp.fcs = FCS_INIT;
+    return type;
+  }
+
+  if( byte==BIN_ESC ) {
+    unp.esc = 1;
+    return 0;
   }
 
+  if( unp.esc ) {
+    byte ^= BIN_XOR;
+    unp.esc = 0;
+  }
+
+  unp.fcs = _crc_ccitt_update( unp.fcs, byte );
+  if( unp.error )
+    return 0;
+
+  if( unp.n==0 ) {
+    unp.type = byte;
+    if( byte==BIN_TX || byte==BIN_PACKET || byte==BIN_CODED ) {
+      msg_reset( msg );
+      if( byte!=BIN_TX ) {
+        msg->format = ( byte==BIN_PACKET ) ? TX_PACKET : TX_CODED;
+        msg->state = S_RAW;
+      }
+    } else if( byte!=BIN_CMD && byte!=BIN_AT ) {
+      unp.error = 1;
+    }
+  } else if( unp.type==BIN_TX ) {
+    if( !msg_unpack_tx( msg, byte ) )
+      unp.error = 1;
+  } else if( unp.type!=BIN_CMD && unp.type!=BIN_AT ) {
+    if( !msg_raw_byte( msg, byte ) )
+      unp.error = 1;
+  } else {  // BIN_CMD, BIN_AT
+    if( unp.n <= sizeof(unp.cmd) )
+      unp.cmd[ unp.n-1 ] = byte;
+    else
+      unp.error = 1;
+  }
+
+  if( unp.n < 255 )
+    unp.n++;
+
   return 0;
 }
 
@@ -959,7 +1947,15 @@ static uint8_t msg_tx_checksum( struct message *msg, uint8_t *done ) {
 }
 
 static uint8_t msg_tx_process( struct message *msg, uint8_t *done ) {
-  uint8_t byte = 0, d;
+  uint8_t byte = 0, d = 1;
+
+  if( msg->format==TX_PACKET ) {  // Built by the host
+    d = ( msg->count >= msg->nPayload );
+    if( !d )
+      byte = msg->payload[ msg->count++ ];
+    (*done) = d;
+    return byte;
+  }
 
   switch( msg->state ) {
   case S_START:
@@ -985,41 +1981,91 @@ static uint8_t msg_tx_process( struct message *msg, uint8_t *done ) {
 }
 
 
+// Encode a TX message over its own record, which then holds it coded.
+// The payload is at the end so each pair is written behind the packet
+// bytes still to be read.
+static void msg_tx_code( struct message *msg ) {
+  uint8_t *coded = msg->raw;   // Start of the record's data
+  uint8_t n = 0, byte, done;
+
+  if( msg->format==TX_CODED )
+    return;
+
+  msg->state = S_START;
+  msg->count = 0;
+  while( byte = msg_tx_process( msg, &done ), !done ) {
+    frame_man_encode( coded+n, byte );
+    n += 2;
+  }
+
+  msg->format = TX_CODED;
+  msg->payload = coded;
+  msg->nPayload = n;
+}
+
+// The frame is sent from its record
 static struct message *TxMsg;
 static void msg_tx_start( struct message **msg ) {
   if( msg && (*msg) ) {
     TxMsg = (*msg);
-    frame_tx_start( TxMsg->raw, MAX_RAW );
+    msg_tx_code( TxMsg );
+    frame_tx_start( TxMsg->payload, TxMsg->nPayload );
     (*msg) = NULL;
   }
 }
 
-uint8_t msg_tx_byte(uint8_t *done) {
-  uint8_t byte=0x00;
-
+void msg_tx_end( uint8_t nBytes ) {
   if( TxMsg ) {
-    byte = msg_tx_process( TxMsg, done );
-  } else {
-    *done = 1;
+    TxMsg->nBytes = nBytes;
   }
-
-  return byte;
 }
 
-void msg_tx_end( uint8_t nBytes ) {
-  if( TxMsg ) {
-    TxMsg->nBytes = nBytes;
+// A frame is decoded from what was sent, in place in its record
+// Each payload byte is decoded from bytes further on
+static void msg_tx_echo( struct message *msg ) {
+  uint8_t *coded = msg->payload;
+  uint8_t nBytes = msg->nBytes;
+  uint8_t error = MSG_OK;
+  uint8_t i;
+
+  msg_reset( msg );
+  msg->nBytes = nBytes;
+
+  for( i=0 ; i+1<nBytes && error==MSG_OK ; i+=2 ) {
+    uint16_t byte = frame_man_decode( coded+i );
+    if( byte > 0xFF )
+      error = MSG_MANC_ERR;
+    else if( i==0 && !msg_rx_header_valid( byte ) )
+      error = MSG_SIG_ERR;
+    else {
+      msg_rx_process( msg, byte );
+      error = msg->error;
+    }
   }
+
+  if( error==MSG_OK && msg->state!=S_COMPLETE )
+    error = MSG_TRUNC_ERR;  // No checksum
+  msg->error = msg_rx_check( msg, error );
 }
 
-void msg_tx_done(void) {
+// A frame that wasn't sent is echoed with the reason
+void msg_tx_done( uint8_t error ) {
   if( TxMsg ) {
+    if( TxMsg->format!=TX_FIELDS )
+      msg_tx_echo( TxMsg );
+    if( error )
+      TxMsg->error = error;
+
+    // The coded bytes have been decoded over
+    TxMsg->nBytes = 0;
+
     // Make sure there's an RSSI value to print
     TxMsg->rxFields |= F_RSSI;
     TxMsg->rssi = 0;
 
     // Echo what we transmitted
-    msg_rx_ready( &TxMsg );
+    msg_rx_ready( TxMsg );
+    msg_free( &TxMsg );
   }
 }
 
@@ -1036,50 +2082,139 @@ static uint8_t inCmd;
 static char *cmdBuff;
 static uint8_t nCmd;
 
+// In binary mode a command reply is sent as a BIN_CMD frame
+static struct msg_reply {
+  uint8_t framed;
+  uint8_t n;
+  uint8_t out;
+  uint16_t fcs;
+  char buff[TXBUF];
+} rpl;
+
+static void msg_put_reply(void) {
+  uint8_t n;
+
+  if( !rpl.n ) {  // Next piece of the frame
+    rpl.out = 0;
+    if( !rpl.framed ) {
+      uint8_t type = BIN_CMD;
+      rpl.fcs = FCS_INIT;
+      rpl.buff[rpl.n++] = BIN_FLAG;
+      rpl.n += bin_put( rpl.buff+rpl.n, &type, 1, &rpl.fcs );
+      rpl.framed = 1;
+    }
+
+    n = ( nCmd < BIN_PAYLOAD_CHUNK ) ? nCmd : BIN_PAYLOAD_CHUNK;
+    rpl.n += bin_put( rpl.buff+rpl.n, (uint8_t *)cmdBuff, n, &rpl.fcs );
+    cmdBuff += n;
+    nCmd -= n;
+
+    if( !nCmd ) {
+      rpl.n += bin_put_fcs( rpl.buff+rpl.n, &rpl.fcs );
+      rpl.framed = 0;
+    }
+  }
+
+  n = tty_put_str( (uint8_t *)rpl.buff + rpl.out, rpl.n );
+  rpl.out += n;
+  rpl.n -= n;
+}
+
+// TX work message, filled by msg_scan()
+static uint8_t txPayload[TX_RAW_BUF];
+static struct message txMsg = { .payload=txPayload };
+
 void msg_work(void) {
-  static struct message *rx = NULL;
-  static struct message *tx = NULL;
+  static struct message *tx = &txMsg;
 
   uint8_t byte;
 
   // Print RX messages
-  if( rx ) {
-    if( !msg_print( rx ) ) {
-      msg_free( &rx );
+  if( rxPrint ) {
+    if( !msg_print( rxPrint ) ) {
+      msg_free( &rxPrint );
+    }
+  } else if( nCmd || rpl.n ) {
+    if( msgBinary || rpl.framed || rpl.n ) {
+      msg_put_reply();
+    } else {
+      uint8_t n = tty_put_str( (uint8_t *)cmdBuff, ( nCmd < TXBUF/2 ) ? nCmd : TXBUF/2 );
+      cmdBuff += n;
+      nCmd -= n;
     }
-  } else if( nCmd ) {
-    nCmd -= tty_put_str( (uint8_t *)cmdBuff, nCmd );
-    if( !nCmd )
+    if( !nCmd && !rpl.n )
       inCmd = 0;
   } else {
     // If we have a message now we'll start printing it next time
-    rx = msg_rx_get();
+    rxPrint = msg_rx_get();
+    if( rxPrint ) {
+      msg_print_start( 0 );
+    } else if( TRACE(TRC_CUT) && rxLive ) {
+      rxLiveRec = msg_reserve( MAX_PAYLOAD+MAX_RAW, 0 );
+      if( rxLiveRec ) {
+        rxLiveRec->list = L_BUSY;
+        rxPrint = msgRx;
+        msg_print_start( 1 );
+      }
+    }
   }
 
   // Process serial data from host
-  if( !tx ) tx = msg_alloc();
-
-  byte = tty_rx_get();
-  if( byte ) {
-    if( !tx || tx->state==S_START ) {
-      if( !nCmd && ( byte==CMD || inCmd ) ) {
-        inCmd = cmd( byte, &cmdBuff, &nCmd );
-        byte = '\0'; // byte has been used
-      }
+  // Everything that has arrived is taken in one pass. Reading stops
+  // while the last message waits for room in the arena or a command
+  // reply is still being sent, the rest stays in the tty buffer.
+  while( 1 ) {
+    if( !tx ) {
+      if( !msg_tx_queue( &txMsg ) )
+        break;
+      tx = &txMsg;
+      msg_reset( tx );
     }
-  }
 
-  if( byte ) {  // Still have an unused byte
-    if( tx ) { // TX message
-      if( msg_scan( tx, byte ) )
-        msg_tx_ready( &tx );
+    if( nCmd || rpl.n )
+      break;
+
+    byte = tty_rx_get();
+    if( !byte )
+      break;
+
+    if( msgBinary ) {
+      switch( msg_unpack( tx, byte ) ) {
+      case BIN_TX:
+        if( msg_tx_queue( tx ) )
+          msg_reset( tx );
+        else
+          tx = NULL;
+        break;
+
+      case BIN_CMD: {
+          uint8_t i;
+          cmd( CMD, NULL, NULL );
+          for( i=0 ; i<unp.nCmd ; i++ )
+            cmd( unp.cmd[i], NULL, NULL );
+          inCmd = cmd( '\r', &cmdBuff, &nCmd );
+        }
+        break;
+      }
+    } else if( tx->state==S_START && ( byte==CMD || inCmd ) ) {
+      inCmd = cmd( byte, &cmdBuff, &nCmd );
+    } else if( msg_scan( tx, byte ) ) {  // TX message
+      if( msg_tx_queue( tx ) )
+        msg_reset( tx );
+      else
+        tx = NULL;
     }
   }
 
+  msg_at_work();
   if( !TxMsg ) {
     struct message *tx1 = msg_tx_get();
-    if( tx1 )
+    if( tx1 && tx1->error ) {  // Missed its schedule, only echoed
+      TxMsg = tx1;
+      msg_tx_done( tx1->error );
+    } else if( tx1 ) {
       msg_tx_start( &tx1 );
+    }
   }
 
 }
@@ -1092,8 +2227,6 @@ void msg_init( uint8_t myClass, uint32_t myID ) {
   MyClass = myClass;
   MyID = myID;
 
-  msg_create_pool();
-
   // Force a version string to be printed
   inCmd = cmd(CMD, NULL,NULL );
   inCmd = cmd('V', NULL,NULL );
@@ -22,19 +22,27 @@ enum message_flags {
   _MSG_ERR( MSG_TRUNC_ERR,    "Truncated" ) \
   _MSG_ERR( MSG_WARNING,      "Warning" ) \
   _MSG_ERR( MSG_SUSPECT_WARN, "Suspect payload" ) \
+  _MSG_ERR( MSG_DUTY_ERR,     "Duty cycle limit" ) \
+  _MSG_ERR( MSG_SCHED_ERR,    "Missed schedule" ) \
+  _MSG_ERR( MSG_BUSY_ERR,     "Channel busy" ) \
 
 #define _MSG_ERR(_e,_t) _e,
 enum msg_err_code { MSG_OK=0, _MSG_ERR_LIST MSG_ERR_MAX };
 #undef _MSG_ERR
 
+extern uint8_t msg_rx_header_valid( uint8_t header );
+extern uint8_t msg_rx_class_valid( uint8_t addr );
 extern uint8_t *msg_rx_start(void);
 extern uint8_t msg_rx_byte(uint8_t byte);
 extern void msg_rx_end( uint8_t nBytes, uint8_t error );
 extern void msg_rx_rssi( uint8_t rssi );
+extern void msg_rx_time( uint32_t ms );
 
-extern uint8_t msg_tx_byte(uint8_t *done);
 extern void msg_tx_end( uint8_t nBytes );
-extern void msg_tx_done(void);
+extern void msg_tx_done( uint8_t error );
+
+extern void msg_binary( uint8_t on );
+extern uint8_t msg_binary_mode(void);
 
 extern void msg_init(uint8_t myClass, uint32_t myID );
 extern void msg_work(void);
@@ -0,0 +1,107 @@
+/***************************************************************
+** prof.c
+**
+** ISR profiling, built with ISR_PROFILE
+**
+** Durations are recorded in ticks of the profiling clock and
+** reported in CPU cycles. Histogram counts stick at 65535.
+*/
+#include <string.h>
+
+#include <avr/interrupt.h>
+
+#include "hal.h"
+#include "prof.h"
+
+#if defined(ISR_PROFILE)
+
+#define TICKS_BUCKET0  ( PROF_BUCKET0 / HAL_PROF_CYCLES )
+
+static struct prof_isr_state {
+  uint32_t count;
+  uint32_t total;
+  uint16_t min;
+  uint16_t max;
+  uint16_t hist[PROF_BUCKETS];
+} prof[PROF_MAX];
+
+void prof_isr( uint8_t isr, uint16_t ticks ) {
+  struct prof_isr_state *p = prof + isr;
+  uint16_t t = ticks / TICKS_BUCKET0;
+  uint8_t bucket = 0;
+
+  while( t && bucket < PROF_BUCKETS-1 ) {
+    t >>= 1;
+    bucket++;
+  }
+
+  {
+    // A nested ISR may be profiled while we're updating
+    uint8_t sreg = SREG;
+    cli();
+
+    p->count++;
+    p->total += ticks;
+    if( ticks < p->min ) p->min = ticks;
+    if( ticks > p->max ) p->max = ticks;
+    if( p->hist[bucket] != 0xFFFF ) p->hist[bucket]++;
+
+    SREG = sreg;
+  }
+}
+
+uint8_t prof_read( uint8_t isr, struct prof_stats *stats ) {
+  struct prof_isr_state *p = prof + isr;
+  uint8_t sreg;
+  uint8_t i;
+
+  if( isr >= PROF_MAX )
+    return 0;
+
+  sreg = SREG;
+  cli();
+
+  stats->count = p->count;
+  stats->total = p->total;
+  stats->min   = p->min;
+  stats->max   = p->max;
+  for( i=0 ; i<PROF_BUCKETS ; i++ )
+    stats->hist[i] = p->hist[i];
+
+  SREG = sreg;
+
+  stats->total *= HAL_PROF_CYCLES;
+  stats->min   *= HAL_PROF_CYCLES;
+  stats->max   *= HAL_PROF_CYCLES;
+  if( !stats->count ) stats->min = 0;
+
+  return 1;
+}
+
+void prof_reset(void) {
+  uint8_t sreg = SREG;
+  uint8_t i;
+  cli();
+
+  memset( prof, 0, sizeof(prof) );
+  for( i=0 ; i<PROF_MAX ; i++ )
+    prof[i].min = 0xFFFF;
+
+  SREG = sreg;
+}
+
+void prof_init(void) {
+  prof_reset();
+  hal_prof_clock_init();
+}
+
+#else
+
+uint8_t prof_read( uint8_t isr __attribute__((unused)), struct prof_stats *stats __attribute__((unused)) ) {
+  return 0;
+}
+
+void prof_reset(void) {}
+void prof_init(void) {}
+
+#endif // ISR_PROFILE
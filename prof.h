@@ -0,0 +1,60 @@
+/***************************************************************
+** prof.h
+**
+** ISR profiling, built with ISR_PROFILE
+**
+** Each profiled ISR is bracketed by PROF_ISR_ENTER() and
+** PROF_ISR_EXIT(). The time between them is measured on a
+** free-running timer and accumulated per ISR. Time spent in
+** interrupts nested inside an ISR is counted against it too.
+*/
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdint.h>
+
+#include "hal.h"
+
+enum prof_isrs {
+  PROF_GDO2,
+  PROF_SW,
+  PROF_RX_OVF,
+  PROF_TX_CLOCK,
+  PROF_TTY_RX,
+  PROF_GDO0,
+  PROF_TTY_UDRE,
+  PROF_MAX
+};
+
+// Bucket 0 is below 64 cycles, each one after is twice as wide
+// and the last one takes everything from 4096 cycles up
+#define PROF_BUCKETS     8
+#define PROF_BUCKET0     64
+
+struct prof_stats {
+  uint32_t count;
+  uint32_t total;     // Cycles
+  uint32_t min;       // Cycles
+  uint32_t max;       // Cycles
+  uint16_t hist[PROF_BUCKETS];
+};
+
+#if defined(ISR_PROFILE)
+
+#define PROF_ISR_ENTER()     uint16_t profStart = HAL_PROF_CLOCK()
+#define PROF_ISR_EXIT(_isr)  prof_isr( _isr, HAL_PROF_CLOCK_EXIT() - profStart )
+
+extern void prof_isr( uint8_t isr, uint16_t ticks );
+
+#else
+
+#define PROF_ISR_ENTER()     do{}while(0)
+#define PROF_ISR_EXIT(_isr)  do{}while(0)
+
+#endif
+
+extern uint8_t prof_read( uint8_t isr, struct prof_stats *stats );
+extern void prof_reset(void);
+extern void prof_init(void);
+
+#endif // _PROF_H_
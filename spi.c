@@ -2,6 +2,9 @@
 
 #include "spi.h"
 
+// The host build provides its own SPI backend (host/spi_host.c)
+#if !defined(HOST_BUILD)
+
 static void spi_set_clock( uint32_t Fosc, uint32_t sckFreq )
 {
   // ATMEGA328 data sheet Table23-5
@@ -77,3 +80,4 @@ uint8_t spi_strobe(uint8_t b) {
   return result;
 }
 
+#endif // !HOST_BUILD
@@ -3,22 +3,29 @@
 **
 ** emulate a UART
 **  RX: capturing edges and analyse to acquire byte
+**      (or fifo_uart.c when built with UART_RX_FIFO)
 **  TX: generate edges
+**      (or fifo_uart.c when built with UART_TX_FIFO)
 */
 
-#include "config.h"
+#include "hal.h"
 
 #include <string.h>
 #include <util/delay.h>
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #include "frame.h"
 #include "uart.h"
+#include "fifo_uart.h"
+#include "prof.h"
 
 #define DEBUG_ISR(_v)      DEBUG1(_v)
 #define DEBUG_EDGE(_v)     DEBUG2(_v)
 
+#if !defined(UART_RX_FIFO)
+
 /***************************************************************
 ** BIT constants
 ** These are based on a 500 KHz clock
@@ -47,6 +54,10 @@
 #define TEN_BITS_MAX  ( TEN_BITS + HALF_BIT )
 #define STOP_BITS_MAX ( TEN_BITS + NINE_BITS - HALF_BIT  )
 
+// Minimum number of measured bits for clock recovery
+#define MIN_CLK_BITS  8
+#define MAX_CLK_BITS 32
+
 /***********************************************************************************
 ** RX Frame state machine
 */
@@ -63,7 +74,33 @@ enum uart_rx_states {
 };
 
 
+/***********************************************************************************
+** Edge ring
+** The edge ISR fills one slot per byte and the edge analysis ISR decodes
+** them in order, so decode can fall RX_EDGE_SLOTS-1 bytes behind before
+** a byte is lost.
+*/
 #define MAX_EDGE 24
+
+#if !defined(RX_EDGE_SLOTS)
+  #define RX_EDGE_SLOTS 4
+#endif
+#if ( RX_EDGE_SLOTS & ( RX_EDGE_SLOTS-1 ) ) || ( RX_EDGE_SLOTS < 2 ) || ( RX_EDGE_SLOTS > 128 )
+  #error "RX_EDGE_SLOTS must be a power of 2 from 2 to 128"
+#endif
+#define RX_SLOT(_i) ( (_i) & ( RX_EDGE_SLOTS-1 ) )
+
+struct rx_slot {
+  uint8_t nEdges;
+  uint8_t code;     // Passed on instead of the decoded byte
+  uint8_t start;    // First byte of a frame
+  uint8_t edges[MAX_EDGE];
+};
+
+static struct uart_rx_stats {
+  uint16_t overrun;   // Bytes lost because decode fell too far behind
+} rxStats;
+
 static struct uart_rx_state {
   uint16_t time;
   uint16_t lastTime;
@@ -79,19 +116,102 @@ static struct uart_rx_state {
   uint8_t nByte;
   uint8_t lastByte;
 
-  // Edge buffers
-  uint8_t Edges[2][MAX_EDGE];
-  uint8_t NEdges[2];
+  // Clock recovery
+  uint16_t ticks;     // Latest interval at full timer resolution
+  uint16_t clkTime;
+  uint8_t  clkBits;
+  uint16_t frmTime;
+  uint8_t  frmBits;
+  uint8_t  frmStart;
+  uint8_t  clkNew;
+
+  // Per-frame bit timing
+  int8_t  frmCorr;
+  int8_t  clkCorr;
+  uint8_t tenBitsMin;
+  uint8_t stopBitsMax;
+
+  // Edge ring
+  struct rx_slot slot[RX_EDGE_SLOTS];
+  volatile uint8_t head;   // Slot being filled by the edge ISR
+  volatile uint8_t tail;   // Next slot to decode
+  uint8_t lost;            // A byte was dropped, abort the frame
+  uint8_t decoding;
 
   // Current edges
-  uint8_t idx;
   uint8_t nEdges;
   uint8_t *edges;
 } rx;
 
+static uint8_t clockShift;
+
 static void rx_reset(void) {
   memset( &rx, 0, sizeof(rx) );
-  rx.edges = rx.Edges[ rx.idx ];
+  rx.state = RX_IDLE;
+  rx.edges = rx.slot[0].edges;
+  rx.tenBitsMin  = TEN_BITS_MIN;
+  rx.stopBitsMax = STOP_BITS_MAX;
+}
+
+/***********************************************************************************
+** Clock recovery
+**
+** Transmitter clocks drift, so the bit period is measured on every frame.
+** The preamble (0x55) has an edge on every bit and SYNC0 (0xFF) is 9 bits
+** HIGH.  The edge ISR only totals these periods; the bit period is worked
+** out by the edge analysis ISR once SYNC1 (0x00) has been seen.
+**
+** The edge intervals of each byte are corrected to the nominal bit period
+** before they are decoded and the STOP bit limits are scaled to match.
+*/
+static void rx_clock_reset(void) {
+  rx.clkTime = 0;
+  rx.clkBits = 0;
+}
+
+static void rx_clock_bits( uint8_t nBits ) {
+  if( rx.clkBits >= MAX_CLK_BITS ) { // Age the oldest measurements
+    rx.clkTime >>= 1;
+    rx.clkBits >>= 1;
+  }
+
+  // Full timer resolution avoids the bias of truncated intervals
+  rx.clkTime += rx.ticks;
+  rx.clkBits += nBits;
+}
+
+static void rx_clock_frame(void) {
+  rx.frmTime = rx.clkTime;
+  rx.frmBits = rx.clkBits;
+
+  // Until the bit period is known
+  rx.frmStart    = 1;
+  rx.frmCorr     = 0;
+  rx.tenBitsMin  = TEN_BITS_MIN;
+  rx.stopBitsMax = STOP_BITS_MAX;
+
+  // Work it out in the edge analysis ISR before the first byte ends
+  rx.clkNew = 1;
+  HAL_SW_INT_TRIGGER();
+}
+
+static void rx_clock_recover(void) {
+  uint16_t bit16 = ONE_BIT<<4;  // Bit period in 1/16ths
+  uint16_t tenBits, nineBits, halfBit, stopBitsMax;
+
+  if( rx.frmBits >= MIN_CLK_BITS )
+    bit16 = ( rx.frmTime<<( 4-clockShift ) ) / rx.frmBits;
+
+  // Correction to nominal bit period in 1/256ths
+  rx.frmCorr = (int8_t)( ( (uint16_t)ONE_BIT<<12 ) / bit16 - 256 );
+
+  tenBits  = ( bit16*10 + 8 ) >> 4;
+  nineBits = ( bit16*9  + 8 ) >> 4;
+  halfBit  = ( bit16    + 16 ) >> 5;
+
+  stopBitsMax = tenBits + nineBits - halfBit;
+  rx.stopBitsMax = ( stopBitsMax > 255 ) ? 255 : stopBitsMax;
+  rx.tenBitsMin  = tenBits - halfBit;
 }
 
 /***********************************************************************************
@@ -125,10 +245,16 @@ static uint8_t rx_high( uint8_t interval ) {
   uint8_t state = RX_HIGH;    // Stay here until we see a LOW
 
   if( !rx.level ) { // falling edge
-   if( interval >= NINE_BITS_MIN )
+   if( interval >= NINE_BITS_MIN ) {
+      rx_clock_bits( 9 );
       state = RX_SYNC1;  // This was SYNC0, go look explicitly for SYNC1
-    else
+    } else {
+      if( interval >= MIN_BIT && interval <= MAX_BIT )
+        rx_clock_bits( 1 );
+      else
+        rx_clock_reset();
       state = RX_LOW;
+    }
   }
 
   return state;
@@ -136,10 +262,14 @@ static uint8_t rx_high( uint8_t interval ) {
 
 //-----------------------------------------------------------------------------
 // check low signals
-static uint8_t rx_low( uint8_t interval __attribute__((unused))) {
+static uint8_t rx_low( uint8_t interval ) {
   uint8_t state = RX_LOW;    // Stay here until we see a HIGH
 
   if( rx.level ) { // rising edge
+    if( interval >= MIN_BIT && interval <= MAX_BIT )
+      rx_clock_bits( 1 );
+    else
+      rx_clock_reset();
     state = RX_HIGH;
   }
 
@@ -152,9 +282,10 @@ static uint8_t rx_sync1( uint8_t interval ) {
   if( rx.level ) {  // rising edge
 
     // NOTE: we're accepting 9 or 10 bits here because of observed behaviour
-    if( interval >= NINE_BITS_MIN && interval <= TEN_BITS_MAX )
+    if( interval >= NINE_BITS_MIN && interval <= TEN_BITS_MAX ) {
+      rx_clock_frame();
       state = RX_STOP;  // Now we just need the STOP bit for BYTE synch
-    else
+    } else
       state = RX_HIGH;
   }
 
@@ -179,21 +310,36 @@ static uint8_t rx_stop_bit( uint8_t interval __attribute__((unused))) {
 //-----------------------------------------------------------------------------
 // gather bytes for frame
 
-static void rx_byte(void) {
+static void rx_byte( uint8_t code ) {
+  uint8_t head = rx.head;
+
   rx.nByte++;
 
-  // Switch edge buffer
-  rx.NEdges[rx.idx] = rx.nEdges;
-  rx.idx ^= 1;
-  rx.edges = rx.Edges[rx.idx];
+  if( (uint8_t)( head+1 - rx.tail ) < RX_EDGE_SLOTS ) {
+    struct rx_slot *slot = rx.slot + RX_SLOT(head);
+
+    slot->nEdges = rx.nEdges;
+    slot->code   = ( rx.lost ) ? FRM_LOST_SYNC : code;
+    slot->start  = rx.frmStart;
+    rx.frmStart = 0;
+    rx.lost = 0;
+
+    // Publish it and move to the next slot
+    head++;
+    rx.head = head;
+    rx.edges = rx.slot[ RX_SLOT(head) ].edges;
+  } else { // Ring full, reuse this slot
+    rxStats.overrun++;
+    rx.lost = 1;
+  }
   rx.nEdges = 0;
 
-  SW_INT_PIN |= SW_INT_IN;
+  HAL_SW_INT_TRIGGER();
 }
 
 static uint8_t rx_abort(uint8_t code) {
   rx.lastByte = code;
-  rx_byte();
+  rx_byte( code );
   return ( rx.level ) ? RX_HIGH : RX_SYNC1;
 }
 
@@ -203,10 +349,10 @@ static uint8_t rx_synch(uint8_t interval) {
   if( rx.nEdges < MAX_EDGE ) {
     rx.edges[rx.nEdges++] = interval;
 
-    if( interval>TEN_BITS_MIN ) {
-      if( interval < STOP_BITS_MAX ) { // Possible stop bit
+    if( interval>rx.tenBitsMin ) {
+      if( interval < rx.stopBitsMax ) { // Possible stop bit
         if( !rx.level ) { // Was a falling edge so probably valid stop bit
-          rx_byte();
+          rx_byte( 0 );
           state = RX_SYNCH0;
         } else { // Lost BYTE synch
           state = rx_abort(FRM_LOST_SYNC);
@@ -265,10 +411,6 @@ static uint8_t rx_edge(uint8_t interval) {
 **
 */
 
-#define RX_CLOCK TCNT1
-
-static uint8_t clockShift;
-
 static void rx_edge_detected(void) {
   uint16_t interval;
   uint8_t synch;
@@ -276,7 +418,8 @@ static void rx_edge_detected(void) {
   if( rx.overflow && ( ( rx.overflow > 1 ) || ( rx.time > rx.time0 ) ) ) {
       interval = 255;
   } else {
-    interval = ( rx.time - rx.time0 ) >> clockShift;
+    rx.ticks = rx.time - rx.time0;
+    interval = rx.ticks >> clockShift;
     if( interval > 255 ) interval = 255;
   }
   rx.overflow = 0;
@@ -290,19 +433,26 @@ static void rx_edge_detected(void) {
 ISR(GDO2_INT_VECT) {
   DEBUG_ISR(1);
 
-  rx.time  = RX_CLOCK;                // Grab a copy of the counter ASAP for accuracy
-  rx.level = ( GDO2_PIN & GDO2_IN );  // and the current level
+  rx.time  = HAL_GDO2_EDGE_TIME();   // Grab a copy of the counter ASAP for accuracy
+  rx.level = HAL_GDO2_EDGE_LEVEL();  // and the current level
+  PROF_ISR_ENTER();
+  hal_gdo2_edge_next();
 
   if( rx.level != rx.lastLevel )
 	rx_edge_detected();
 
+  PROF_ISR_EXIT( PROF_GDO2 );
   DEBUG_ISR(0);
 }
 
-ISR(TIMER1_OVF_vect) {
+ISR(RX_CLOCK_OVF_VECT) {
+  PROF_ISR_ENTER();
+
   rx.overflow += 1;
   if( rx.overflow > 1 )
     rx_edge_detected();
+
+  PROF_ISR_EXIT( PROF_RX_OVF );
 }
 
 /***************************************************************************
@@ -310,17 +460,11 @@ ISR(TIMER1_OVF_vect) {
 */
 
 static void rx_init(void) {
-  TCCR1A = 0; // Normal mode, no output pins
-
-  // We want to prescale the hardware timer as much as possible
-  // to maximise the period between overruns but remain above 500 KHz
-  TCCR1B = ( 1<<CS11 ); // Pre-scale by 8
+  hal_rx_clock_init();
 
   // This is the additional scaling required in software to reduce the
   // clock rate to 500 KHz
   clockShift = ( F_CPU==16000000 ) ? 2 : 1;
-
-  TIMSK1 |= TOIE1;
 }
 
 /********************************************************
@@ -330,65 +474,105 @@ static void rx_init(void) {
 ** ISR.
 ********************************************************/
 
-static uint8_t rx_process_edges( uint8_t *edges, uint8_t nEdges ) {
+/********************************************************
+** Edge decode table
+**
+** The edge intervals of a byte are measured from the start
+** of the START bit and the signal level toggles at each edge,
+** starting LOW.
+**
+** Each data bit is sampled at the centre of its nominal bit period.
+** An edge at interval t toggles every data bit sampled after t,
+** so XORing the table entries for all the edges of a byte leaves
+** the data bits (little-endian) that were HIGH.
+**
+** Edges from the STOP bit onwards don't affect any data bit.
+*/
+#define RX_SAMPLE(_bit)      ( ( (_bit)+1 )*ONE_BIT + HALF_BIT )
+#define RX_TOGGLE(_t,_bit)   ( ( (_t) < RX_SAMPLE(_bit) ) ? ( 1<<(_bit) ) : 0 )
+#define RX_MASK(_t)          ( RX_TOGGLE(_t,0) | RX_TOGGLE(_t,1) | RX_TOGGLE(_t,2) | RX_TOGGLE(_t,3) \
+                             | RX_TOGGLE(_t,4) | RX_TOGGLE(_t,5) | RX_TOGGLE(_t,6) | RX_TOGGLE(_t,7) )
+#define RX_MASK4(_t)         RX_MASK(_t), RX_MASK(_t+1), RX_MASK(_t+2), RX_MASK(_t+3)
+#define RX_MASK16(_t)        RX_MASK4(_t), RX_MASK4(_t+4), RX_MASK4(_t+8), RX_MASK4(_t+12)
+
+static uint8_t const rx_edge_mask[256] PROGMEM = {
+  RX_MASK16(   0 ), RX_MASK16(  16 ), RX_MASK16(  32 ), RX_MASK16(  48 ),
+  RX_MASK16(  64 ), RX_MASK16(  80 ), RX_MASK16(  96 ), RX_MASK16( 112 ),
+  RX_MASK16( 128 ), RX_MASK16( 144 ), RX_MASK16( 160 ), RX_MASK16( 176 ),
+  RX_MASK16( 192 ), RX_MASK16( 208 ), RX_MASK16( 224 ), RX_MASK16( 240 )
+};
+#define RX_EDGE_MASK(_t) pgm_read_byte( rx_edge_mask+(_t) )
+
+static uint8_t rx_process_edges( uint8_t const *edges, uint8_t nEdges, int8_t corr ) {
   uint8_t rx_byte = 0;
-  uint8_t rx_t = 0;
-  uint8_t rx_tBit = ONE_BIT;
-  uint8_t rx_isHi = 0;
-  uint8_t rx_hi = 0;
 
   while( nEdges-- ) {
-    uint8_t interval = *(edges++);
-
-    if( rx_tBit < TEN_BITS ) { //
-      uint8_t samples = interval - rx_t;
-      while( samples ) {
-        uint8_t tBit = rx_tBit - rx_t;
-        if( tBit > samples )
-          tBit = samples;
-
-        if( rx_isHi ) rx_hi += tBit;
-
-        rx_t += tBit;
-        samples -= tBit;
-
-        // BIT complete?
-        if( rx_t==rx_tBit ) {
-          if( rx_tBit == ONE_BIT ) { // START BIT
-          } else if( rx_tBit < TEN_BITS ) {
-            uint8_t bit = ( rx_hi > HALF_BIT ) ? 0x80 : 0x00 ;
-            rx_byte >>= 1;
-            rx_byte  |= bit;
-          }
-
-          rx_tBit += ONE_BIT;
-          rx_hi = 0;
-        }
-      }
+    uint8_t t = *(edges++);
+
+    if( corr ) { // Correct to nominal bit period
+      int16_t nominal = t + ( ( t * corr ) >> 8 );
+      t = ( nominal > 255 ) ? 255 : nominal;
     }
 
-    // Edges toggle level
-    rx_isHi ^= 1;
+    rx_byte ^= RX_EDGE_MASK( t );
   }
 
   return rx_byte;
 }
 
 ISR(SW_INT_VECT) {
-  // Very important that we don't block interrupts
-  // As this interferes with subsequent edge measurements
-  sei();
+  // Only one instance may consume the edge ring.
+  // If we've interrupted it, it will pick up the new slot too.
+  if( rx.decoding )
+    return;
+  rx.decoding = 1;
+
+  PROF_ISR_ENTER();
+
+  do {
+    // Very important that we don't block interrupts
+    // As this interferes with subsequent edge measurements
+    sei();
+
+    DEBUG_EDGE( 1 );
+
+    // Start of a frame, work out its bit period
+    if( rx.clkNew ) {
+      rx.clkNew = 0;
+      rx_clock_recover();
+    }
 
-  DEBUG_EDGE( 1 );
+    while( rx.tail != rx.head ) {
+      struct rx_slot *slot = rx.slot + RX_SLOT(rx.tail);
+      uint8_t byte;
+
+      if( slot->start )
+        rx.clkCorr = rx.frmCorr;
+
+      // Extract byte from the edges
+      byte = ( slot->code ) ? slot->code
+           : rx_process_edges( slot->edges, slot->nEdges, rx.clkCorr );
+      rx.tail++;    // Free the slot
+
+      rx.lastByte = byte;
+
+      DEBUG_EDGE( 0 );
+
+      // And pass it on to frame to process
+      frame_rx_byte( byte );
+
+      DEBUG_EDGE( 1 );
+    }
 
-  // Extract byte from previous edges
-  rx.lastByte = rx_process_edges( rx.Edges[1-rx.idx], rx.NEdges[1-rx.idx] );
+    DEBUG_EDGE( 0 );
 
-  DEBUG_EDGE( 0 );
+    // Check nothing arrived while we were finishing
+    cli();
+  } while( rx.tail != rx.head || rx.clkNew );
 
-  // And pass it on to frame to process
-  frame_rx_byte( rx.lastByte );
+  rx.decoding = 0;
 
+  PROF_ISR_EXIT( PROF_SW );
 }
 
 //---------------------------------------------------------------------------------
@@ -397,19 +581,10 @@ static void rx_start(void) {
   uint8_t sreg = SREG;
   cli();
 
-  // rising and falling edge
-  EICRA &= ~( 1 << GDO2_INT_ISCn0 ) & ~( 1 << GDO2_INT_ISCn1 ) ;
-  EICRA |=  ( 1 << GDO2_INT_ISCn0 );   
-
-  EIFR   = GDO2_INT_MASK ;    // Acknowledge any previous edges
-  EIMSK |= GDO2_INT_MASK ;    // Enable interrupts
+  hal_gdo2_int_enable();
 
   // Configure SW interrupt for edge processing
-  SW_INT_DDR  |= SW_INT_IN;
-  SW_INT_MASK |= SW_INT_IN;
-
-  PCIFR  = SW_INT_ENBL;  // Acknowledge any previous event
-  PCICR |= SW_INT_ENBL;  // and enable
+  hal_sw_int_init();
 
   SREG = sreg;
 }
@@ -417,10 +592,45 @@ static void rx_start(void) {
 //---------------------------------------------------------------------------------
 
 static void rx_stop(void) {
-  EIMSK &= ~GDO2_INT_MASK;  // Disable interrupts
+  hal_gdo2_int_disable();
   rx.state = RX_OFF;
 }
 
+//---------------------------------------------------------------------------------
+
+uint16_t uart_rx_overruns(void) {
+  uint16_t overrun;
+  uint8_t sreg = SREG;
+  cli();
+
+  overrun = rxStats.overrun;
+
+  SREG = sreg;
+  return overrun;
+}
+
+void uart_rx_stats_reset(void) {
+  uint8_t sreg = SREG;
+  cli();
+
+  memset( &rxStats, 0, sizeof(rxStats) );
+
+  SREG = sreg;
+}
+
+#else // UART_RX_FIFO
+
+/***************************************************************************
+** RX by the CC1101 FIFO engine
+*/
+static void rx_init(void)  { fifo_rx_init();  }
+static void rx_reset(void) { fifo_rx_reset(); }
+static void rx_start(void) { fifo_rx_start(); }
+static void rx_stop(void)  { fifo_rx_stop();  }
+
+#endif // UART_RX_FIFO
+
+#if !defined(UART_TX_FIFO)
 
 /***************************************************************************
 ** TX Processing
@@ -445,11 +655,13 @@ static struct uart_tx_state {
 
 static void tx_reset(void) {
   memset( &tx, 0, sizeof(tx) );
+  tx.state = TX_IDLE;
 }
 
-ISR(TIMER0_COMPA_vect) {
+ISR(TX_CLOCK_VECT) {
   uint8_t bit;
   DEBUG_ISR(1);
+  PROF_ISR_ENTER();
 
   if( tx.bitNo==0 ) { // START bit
 	bit = SPACE;
@@ -460,24 +672,19 @@ ISR(TIMER0_COMPA_vect) {
     bit = MARK;
   }
 
-  if( bit ) GDO0_PORT |=  GDO0_IN ;
-  else      GDO0_PORT &= ~GDO0_IN ;
+  HAL_GDO0_OUT( bit );
 
   if( tx.bitNo==0 ) tx.byte = frame_tx_byte();
   tx.bitNo = ( tx.bitNo+1 ) % 10;
 
+  PROF_ISR_EXIT( PROF_TX_CLOCK );
   DEBUG_ISR(0);
 }
 
 //---------------------------------------------------------------------------------
 
 static void tx_init(void) {
-  TCCR0A = ( 1<<WGM01 ); // CTC, no output pins
-  TCCR0B = 0 ;
-	
-  TCCR0B |= ( 1<<CS01 ); // Pre-scale by 8
-
-  OCR0A = 51;	// 38400 baud	
+  hal_tx_clock_init();
 }
 
 //---------------------------------------------------------------------------------
@@ -486,9 +693,8 @@ static void tx_start(void) {
   uint8_t sreg = SREG;
   cli();
 
-  TCNT0 = 0;
-  TIMSK0 |= ( 1<<OCIE0A );
-  GDO0_PORT |=  GDO0_IN ;	// Start in MARK
+  hal_tx_clock_start();
+  HAL_GDO0_OUT( MARK );	// Start in MARK
 
   SREG = sreg;
 }
@@ -496,11 +702,33 @@ static void tx_start(void) {
 //---------------------------------------------------------------------------------
 
 static void tx_stop(void) {
-  TIMSK0 &= ~( 1<<OCIE0A );
+  hal_tx_clock_stop();
   tx.state = TX_OFF;
-  GDO0_PORT &= ~GDO0_IN ;	// Leave in SPACE
+  HAL_GDO0_OUT( SPACE );	// Leave in SPACE
 }
 
+//---------------------------------------------------------------------------------
+
+// Every bit has gone by the time frame_tx_byte() reaches the end
+uint8_t uart_tx_busy(void) {
+  return 0;
+}
+
+#else // UART_TX_FIFO
+
+/***************************************************************************
+** TX by the CC1101 FIFO engine
+*/
+static void tx_init(void)  { fifo_tx_init();  }
+static void tx_reset(void) { fifo_tx_reset(); }
+static void tx_start(void) { fifo_tx_start(); }
+static void tx_stop(void)  { fifo_tx_stop();  }
+
+uint8_t uart_tx_busy(void) {
+  return fifo_tx_busy();
+}
+
+#endif // UART_TX_FIFO
 
 /***************************************************************************
 ** External interface
@@ -512,7 +740,6 @@ void uart_rx_enable(void) {
 
   tx_stop();
   rx_reset();
-  rx.state = RX_IDLE;
 
   SREG = sreg;
 
@@ -525,7 +752,6 @@ void uart_tx_enable(void) {
 
   rx_stop();
   tx_reset();
-  tx.state = TX_IDLE;
 
   SREG = sreg;
 
@@ -546,11 +772,7 @@ void uart_init(void) {
   uint8_t sreg = SREG;
   cli();
 
-  GDO0_DDR  |=  GDO0_IN;
-  GDO0_PORT &= ~GDO0_IN;		// Sstart in SPACE
-
-  GDO2_DDR  &= ~GDO2_IN;
-  GDO2_PORT |=  GDO2_IN;		// Set input pull-up
+  hal_gdo_init();
 
   rx_init();
   tx_init();  
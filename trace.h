@@ -6,6 +6,7 @@
 #include <stdint.h>
 
 #define TRC_RAW    0x01
+#define TRC_CUT    0x02  // Print RX messages while they arrive
 
 extern uint8_t trace0;
 
@@ -5,78 +5,89 @@
 */
 #include <avr/interrupt.h>
 
-#include "config.h"
+#include "hal.h"
 #include "trace.h"
 #include "tty.h"
+#include "prof.h"
 
 #define DEBUG_TX(_v)
 #define DEBUG_RX(_v)  DEBUG5(_v)
 
 /**************************************************************************
 ** TX
+**
+** Bytes are queued in a ring and sent by the UDRE ISR, which
+** disables itself once there is nothing left to send. Flow
+** control and echo bytes go ahead of the ring.
+**
+** The ring indices run freely and are masked to access it so
+** every byte of it can be used. Only tty_put_str() advances
+** ttyTx_in and only the ISR advances ttyTx_out.
 */
+#if !defined(TTY_TX_RING)
+  #define TTY_TX_RING 64
+#endif
 
-static uint8_t ttyTx_in;
-static uint8_t ttyTx_out;
-static uint8_t ttyTx[TXBUF];
-
-static uint8_t tty_tx_get(void) {
-  uint8_t byte = 0x00;
-
-  if( ttyTx_out != ttyTx_in ) {
-    byte = ttyTx[ttyTx_out];
-    ttyTx_out = ( ttyTx_out+1 ) % TXBUF;
-  }
+#if ( TTY_TX_RING & ( TTY_TX_RING-1 ) ) || TTY_TX_RING > 128
+  #error "TTY_TX_RING must be a power of two no bigger than 128"
+#endif
+#define TX_MASK ( TTY_TX_RING-1 )
 
-  return byte;
-}
+static volatile uint8_t ttyTx_in;
+static volatile uint8_t ttyTx_out;
+static uint8_t ttyTx[TTY_TX_RING];
 
 static volatile uint8_t rxControl = 0;
 static volatile uint8_t echo = 0;
+
+// Called from the UDRE ISR, the USART is ready for a byte
 static void tty_do_tx( void ) {
   uint8_t byte;
 
-  if( UCSR0A & ( 1<<UDRE0 ) ) { // TX buffer is empty
-    if( rxControl ) { // RX Flow control takes priority
-      byte = rxControl;
-      rxControl = 0;
-    } else if( echo ) {
-      byte = echo;
-      echo = 0;
-    } else {
-      byte = tty_tx_get();
-    }
-
-    if( byte != 0x00 ) {
-      DEBUG_TX(1);
-      UDR0 = byte;
-      DEBUG_TX(0);
-    }
+  if( rxControl ) { // RX Flow control takes priority
+    byte = rxControl;
+    rxControl = 0;
+  } else if( echo ) {
+    byte = echo;
+    echo = 0;
+  } else if( ttyTx_out != ttyTx_in ) {
+    byte = ttyTx[ ttyTx_out & TX_MASK ];
+    ttyTx_out++;
+  } else {
+    hal_tty_udre_int_disable();  // Nothing left to send
+    return;
   }
+
+  DEBUG_TX(1);
+  HAL_TTY_TX( byte );
+  DEBUG_TX(0);
 }
 
-static void tty_tx_put(uint8_t byte) {
-  ttyTx[ ttyTx_in ] = byte;
-  ttyTx_in = ( ttyTx_in+1 ) % TXBUF;
-  if( ttyTx_in == ttyTx_out ) { // BAD things could happen if we hit this
-    ttyTx_out = ( ttyTx_out+1 ) % TXBUF;
-  }
+static void tty_tx_kick(void) {
+  uint8_t sreg = SREG;
+  cli();
+
+  hal_tty_udre_int_enable();
+
+  SREG = sreg;
 }
 
 uint8_t tty_put_str( uint8_t *byte, uint8_t nByte ) {
-  uint8_t space = ( ( ( ttyTx_out+TXBUF ) - ttyTx_in - 1 ) % TXBUF );
+  uint8_t in = ttyTx_in;
+  uint8_t space = TTY_TX_RING - (uint8_t)( in - ttyTx_out );
+  uint8_t n;
 
-  if( space < nByte )
-    return 0;  // Didn't send anything
+  if( nByte > space )
+    nByte = space;
 
-  space = nByte;
-  while( nByte ) {
-    tty_tx_put( *byte );
-    byte++;
-    nByte--;
-  }
+  for( n=0 ; n<nByte ; n++ )
+    ttyTx[ (in++) & TX_MASK ] = byte[n];
+  ttyTx_in = in;
+
+  if( nByte )
+    tty_tx_kick();
 
-  return space;
+  return nByte;
 }
 
 /**************************************************************************
@@ -90,10 +101,15 @@ static uint8_t ttyRx[RXBUF];
 #define XOFF ( 'S' & 0x3F ) // ctrl-S
 #define XON  ( 'Q' & 0x3F ) // ctrl-Q
 
+// Called by both the RX ISR and tty_rx_get()
 static void tty_rx_control(void) {
-  static uint8_t state = XOFF;
-  uint8_t newState = state;
-  uint8_t bytes = ( ttyRx_in+RXBUF  - ttyRx_out ) % RXBUF;
+  static uint8_t state = XON;  // What the host assumes at start
+  uint8_t newState, bytes;
+  uint8_t sreg = SREG;
+  cli();
+
+  newState = state;
+  bytes = ( ttyRx_in+RXBUF  - ttyRx_out ) % RXBUF;
 
   switch( state ) {
   case XOFF:
@@ -114,7 +130,10 @@ static void tty_rx_control(void) {
   if( state != newState ) {
     state = newState;
     rxControl = state;
+    tty_tx_kick();
   }
+
+  SREG = sreg;
 }
 
 static void tty_rx_put(uint8_t byte) {
@@ -139,23 +158,30 @@ uint8_t tty_rx_get(void) {
 }
 
 static void tty_do_rx() {
-  if( UCSR0A & ( 1<<RXC0 ) ) { // RX buffer is full
-    uint8_t byte = UDR0;
+  if( HAL_TTY_RX_READY() ) { // RX buffer is full
+    uint8_t byte = HAL_TTY_RX();
     sei();  // Mustn't risk delaying RX edge ISR
     DEBUG_RX(0);
     tty_rx_put( byte );
+    tty_rx_control();  // Main loop may not be reading
   }
 }
 
 /**************************************************************************
 ** TX Control
 */
+ISR(TTY_UDRE_VECT) {
+  PROF_ISR_ENTER();
+  tty_do_tx();
+  PROF_ISR_EXIT( PROF_TTY_UDRE );
+}
+
 void tty_start_tx(void) {
   uint8_t sreg = SREG;
   cli();
 
-  UCSR0B &= ~( 1<<UDRIE0 );
-  UCSR0B |=  ( 1<<TXEN0 );
+  hal_tty_tx_enable();
+  hal_tty_udre_int_enable();  // Sends anything already queued
 
   SREG = sreg;
 }
@@ -164,8 +190,7 @@ void tty_stop_tx(void) {
   uint8_t sreg = SREG;
   cli();
 
-  UCSR0B &= ~( 1<<TXEN0 );
-  UCSR0B &= ~( 1<<UDRIE0 );
+  hal_tty_tx_disable();
 
   SREG = sreg;
 }
@@ -176,7 +201,9 @@ void tty_stop_tx(void) {
 
 ISR(TTY_RX_VECT) {
   DEBUG_RX(1);
+  PROF_ISR_ENTER();
   tty_do_rx();
+  PROF_ISR_EXIT( PROF_TTY_RX );
   DEBUG_RX(0);
 }
 
@@ -184,11 +211,7 @@ void tty_start_rx(void) {
   uint8_t sreg = SREG;
   cli();
 
-  // Enable the interrupt while disabled - RX buffer will be empty
-  UCSR0B |= ( 1<<RXCIE0 );
-
-  // Then enable RX
-  UCSR0B |= ( 1<<RXEN0 );
+  hal_tty_rx_enable();
 
   SREG = sreg;
 }
@@ -199,8 +222,7 @@ void tty_stop_rx(void) {
 
   ttyRx_in = ttyRx_out = 0;
 
-  UCSR0B &= ~( 1<<RXEN0 );
-  UCSR0B &= ~( 1<<RXCIE0 );
+  hal_tty_rx_disable();
 
   SREG = sreg;
 }
@@ -209,56 +231,8 @@ void tty_stop_rx(void) {
 ** Initialisation
 */
 
-static void tty_init_uart( uint32_t Fosc, uint32_t bitrate )
-{
-  uint32_t ubrr_0, actual_0, error_0;
-  uint32_t ubrr_1, actual_1, error_1;
-
-  ubrr_0  = bitrate*8;  // Rounding adjustment
-  ubrr_0 += Fosc;
-  ubrr_0 /= 16;
-  ubrr_0 /= bitrate;
-  ubrr_0 -= 1;
-
-  actual_0  = Fosc / 16;
-  actual_0 /= ubrr_0+1;
-
-  ubrr_1  = bitrate*4;  // Rounding adjustment
-  ubrr_1 += Fosc;
-  ubrr_1 /= 8;
-  ubrr_1 /= bitrate;
-  ubrr_1 -= 1;
-
-  actual_1  = Fosc / 8;
-  actual_1 /= ubrr_1+1;
-
-  error_0 = ( actual_0 > bitrate ) ? actual_0 - bitrate : bitrate - actual_0;
-  error_1 = ( actual_1 > bitrate ) ? actual_1 - bitrate : bitrate - actual_1;
-  if( error_0 <= error_1 ) {  // Prefer U2X0=0
-    UCSR0A = 0;
-    UBRR0 = ubrr_0;
-  } else {
-    UCSR0A = ( 1 << U2X0 );
-    UBRR0 = ubrr_1;
-  }
-
-  UCSR0B = ( 0 << RXCIE0 ) | ( 0 << TXCIE0 ) | ( 0 << UDRIE0 )  // Interrupts disabled
-         | ( 0 << RXEN0  ) | ( 0 << TXEN0  )                    // RX+TX disabled
-         | ( 0 << UCSZ02 );                                     // 8 Bits
-
-  UCSR0C  = ( 0 << UMSEL01 ) | ( 0 << UMSEL00 )   // Asynchronous
-          | ( 0 << UPM01   ) | ( 0 << UPM00   )   // Parity disable
-          | ( 0 << USBS0   )                      // 1 stop bit
-          | ( 1 << UCSZ01  ) |  ( 1 << UCSZ00 )   // 8 data bits
-          | ( 0 << UCPOL0  );
-}
-
 void tty_init(void ) {
-  tty_init_uart( F_CPU, TTY_BAUD_RATE );
+  hal_tty_init( F_CPU, TTY_BAUD_RATE );
   tty_start_tx();
   tty_start_rx();
 }
-
-void tty_work(void) {
-  tty_do_tx();
-}
@@ -8,12 +8,13 @@
 
 #include <stdint.h>
 
+// Largest piece of text the application formats at once
 #define TXBUF 32
 #define RXBUF 32
 
 // Application UART write
-//   nByte MUST be less than TXBUF
-//   returns number of bytes sent to UART
+//   queues as many of the nByte as there is room for
+//   returns number of bytes queued
 extern uint8_t tty_put_str( uint8_t *byte, uint8_t nByte );
 extern void tty_start_tx(void);
 extern void tty_stop_tx(void);
@@ -23,6 +24,5 @@ extern void tty_start_rx(void);
 extern void tty_stop_rx(void);
 
 extern void tty_init(void);
-extern void tty_work(void);
 
 #endif // _TTY_H_
@@ -5,12 +5,21 @@
 #ifndef _UART_H_
 #define _UART_H_
 
+#include <stdint.h>
+
 extern void uart_rx_enable(void);
 extern void uart_tx_enable(void);
 extern void uart_disable(void);
 
+// Radio still sending after frame_tx_byte() has reached the end
+extern uint8_t uart_tx_busy(void);
+
 extern void uart_init(void);
 
+// RX statistics
+extern uint16_t uart_rx_overruns(void);
+extern void uart_rx_stats_reset(void);
+
 #define RADIO_BAUDRATE 38400
 
 #endif // _UART_H_